@@ -7,6 +7,13 @@
 #include <iomanip>
 #include <cmath>
 #include <string>
+#include <cstdio>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <functional>
+#include <stdexcept>
+#include "../common/instrumentation.h"
 using namespace std;
 using namespace chrono;
 
@@ -60,6 +67,322 @@ struct Metrics {
     }
 };
 
+// Sequential writer for a sorted run of packed states. Each state is stored as
+// its difference from the previous one in a LEB128 varint, so runs of dense
+// layers shrink to a byte or two per state. A full block is written by a
+// background task while the next one fills.
+class RunWriter {
+public:
+    RunWriter(const string& path, size_t block_size) : block_size(block_size) {
+        f = fopen(path.c_str(), "wb");
+        if(!f) throw runtime_error("cannot write " + path);
+        block.reserve(block_size + 10);
+    }
+    RunWriter(const RunWriter&) = delete;
+    RunWriter& operator=(const RunWriter&) = delete;
+    ~RunWriter() { close(); }
+    
+    void put(uint64_t state) {
+        uint64_t delta = state - prev;
+        prev = state;
+        count++;
+        while(delta >= 0x80) {
+            block.push_back(uint8_t(delta) | 0x80);
+            delta >>= 7;
+        }
+        block.push_back(uint8_t(delta));
+        if(block.size() >= block_size) flush();
+    }
+    
+    // Writes what is left and closes the file; false if any write failed.
+    bool close() {
+        if(!f) return !failed;
+        flush();
+        if(pending.valid()) pending.get();
+        fclose(f);
+        f = nullptr;
+        return !failed;
+    }
+    
+    uint64_t states() const { return count; }
+    uint64_t bytes() const { return written; }
+    
+private:
+    FILE* f;
+    size_t block_size;
+    vector<uint8_t> block, writing;
+    future<void> pending;
+    uint64_t prev = 0, count = 0, written = 0;
+    bool failed = false;
+    
+    void flush() {
+        if(pending.valid()) pending.get();
+        written += block.size();
+        swap(block, writing);
+        block.clear();
+        pending = async(launch::async, [this] {
+            if(fwrite(writing.data(), 1, writing.size(), f) != writing.size()) failed = true;
+        });
+    }
+};
+
+// Reads back a run written by RunWriter, one state at a time. The next block is
+// read in the background while the current one is decoded.
+class RunReader {
+public:
+    RunReader(const string& path, size_t block_size) : block_size(block_size) {
+        f = fopen(path.c_str(), "rb");
+        if(!f) throw runtime_error("cannot read " + path);
+        ahead = async(launch::async, [this] { return load(); });
+        advance();
+    }
+    RunReader(const RunReader&) = delete;
+    RunReader& operator=(const RunReader&) = delete;
+    ~RunReader() {
+        if(ahead.valid()) ahead.wait();
+        fclose(f);
+    }
+    
+    bool done() const { return finished; }
+    uint64_t value() const { return current; }
+    uint64_t bytes() const { return read_total; }
+    
+    // Moves to the next state, or sets done() at the end of the file.
+    void advance() {
+        uint64_t delta = 0;
+        int shift = 0, b;
+        do {
+            if((b = next_byte()) < 0) {
+                finished = true;
+                return;
+            }
+            delta |= uint64_t(b & 0x7f) << shift;
+            shift += 7;
+        } while(b & 0x80);
+        current += delta;
+    }
+    
+private:
+    FILE* f;
+    size_t block_size;
+    vector<uint8_t> block, next;
+    size_t pos = 0;
+    future<size_t> ahead;
+    uint64_t current = 0, read_total = 0;
+    bool finished = false;
+    
+    size_t load() {
+        next.resize(block_size);
+        return fread(next.data(), 1, block_size, f);
+    }
+    
+    int next_byte() {
+        if(pos == block.size()) {
+            if(!ahead.valid()) return -1;
+            size_t n = ahead.get();
+            if(n == 0) return -1;
+            swap(block, next);
+            block.resize(n);
+            pos = 0;
+            read_total += n;
+            ahead = async(launch::async, [this] { return load(); });
+        }
+        return block[pos++];
+    }
+};
+
+// Breadth-first search over a rows x cols sliding puzzle (up to 16 cells, so the
+// 15-puzzle fits) with the layers on disk instead of in a visited set: delayed
+// duplicate detection. A state is packed into one 64-bit word, 4 bits per cell.
+// To build layer d+1, layer d is streamed from its file and the successors are
+// collected in a buffer; every full buffer is sorted and written as a run while
+// the other buffer fills. The runs are then merged, dropping every state that is
+// in layer d or d-1 on the way: moves can be undone, so those are the only earlier
+// layers a successor of layer d can be in. Memory is the two buffers plus a couple
+// of blocks per open file, whatever the size of the state space.
+class ExternalBFS {
+public:
+    static constexpr uint64_t NO_TARGET = ~0ULL;
+    
+    ExternalBFS(int rows, int cols, size_t memory_bytes = size_t(64) << 20, const string& dir = ".")
+        : cells(rows * cols), dir(dir) {
+        if(cells > 16) throw invalid_argument("at most 16 cells fit in a packed state");
+        for(int p = 0; p < cells; p++) {
+            int r = p / cols, c = p % cols;
+            vector<int> next;
+            if(r > 0) next.push_back(p - cols);
+            if(r < rows - 1) next.push_back(p + cols);
+            if(c > 0) next.push_back(p - 1);
+            if(c < cols - 1) next.push_back(p + 1);
+            neighbors.push_back(next);
+        }
+        // Half the budget for the two expansion buffers, half for file blocks.
+        block_size = min<size_t>(max<size_t>(memory_bytes / 64, 4096), 1 << 20);
+        buffer_states = max<size_t>(memory_bytes / 4 / sizeof(uint64_t), 1024);
+        max_fan_in = max<size_t>(memory_bytes / 2 / (2 * block_size), 5) - 3;
+    }
+    
+    ~ExternalBFS() {
+        for(int d = 0; d < (int)layers.size(); d++) std::remove(layer_path(d).c_str());
+    }
+    
+    // Board with the tile in cell i (0 = blank) in bits 4i..4i+3.
+    static uint64_t pack(const vector<int>& board) {
+        uint64_t s = 0;
+        for(int i = 0; i < (int)board.size(); i++) s |= uint64_t(board[i]) << (4 * i);
+        return s;
+    }
+    
+    // Searches from start until target is found (returns its depth), the space is
+    // exhausted or max_depth is reached (returns -1). Without a target this sweeps
+    // the whole component of start, and layer_sizes() is its BFS profile.
+    int run(uint64_t start, uint64_t target = NO_TARGET, int max_depth = INT32_MAX) {
+        for(int d = 0; d < (int)layers.size(); d++) std::remove(layer_path(d).c_str());
+        layers.assign(1, 1);
+        expanded = generated = bytes_written = bytes_read = 0;
+        {
+            RunWriter first(layer_path(0), block_size);
+            first.put(start);
+            finish(first);
+        }
+        if(start == target) return 0;
+        
+        for(int d = 0; d < max_depth; d++) {
+            vector<string> runs = expand(d);
+            RunWriter out(layer_path(d + 1), block_size);
+            bool found = false;
+            {
+                unique_ptr<RunReader> current(new RunReader(layer_path(d), block_size));
+                unique_ptr<RunReader> previous(d > 0 ? new RunReader(layer_path(d - 1), block_size) : nullptr);
+                merge(runs, [&](uint64_t s) {
+                    if(seen_in(*current, s) || (previous && seen_in(*previous, s))) return;
+                    out.put(s);
+                    found = found || s == target;
+                });
+                bytes_read += current->bytes() + (previous ? previous->bytes() : 0);
+            }
+            for(const string& path : runs) std::remove(path.c_str());
+            finish(out);
+            layers.push_back(out.states());
+            if(d > 0) std::remove(layer_path(d - 1).c_str());
+            if(found) return d + 1;
+            if(out.states() == 0) break;
+        }
+        return -1;
+    }
+    
+    // States in each layer, from the start (layer 0) to the last one searched.
+    const vector<uint64_t>& layer_sizes() const { return layers; }
+    uint64_t states_expanded() const { return expanded; }
+    uint64_t states_generated() const { return generated; }
+    uint64_t disk_bytes_written() const { return bytes_written; }
+    uint64_t disk_bytes_read() const { return bytes_read; }
+    
+private:
+    int cells;
+    string dir;
+    vector<vector<int>> neighbors;  // cells the blank can move to from each cell
+    size_t block_size, buffer_states, max_fan_in;
+    vector<uint64_t> layers;
+    uint64_t expanded = 0, generated = 0, bytes_written = 0, bytes_read = 0;
+    int run_number = 0;
+    
+    string layer_path(int d) const { return dir + "/ebfs_layer_" + to_string(d) + ".bin"; }
+    string run_path() { return dir + "/ebfs_run_" + to_string(run_number++) + ".bin"; }
+    
+    void finish(RunWriter& w) {
+        if(!w.close()) throw runtime_error("write to " + dir + " failed");
+        bytes_written += w.bytes();
+    }
+    
+    // Writes the successors of layer d as sorted, duplicate-free runs.
+    vector<string> expand(int d) {
+        vector<string> runs;
+        vector<uint64_t> filling, flushing;
+        filling.reserve(buffer_states);
+        future<uint64_t> pending;
+        auto spill = [&] {
+            if(pending.valid()) bytes_written += pending.get();
+            swap(filling, flushing);
+            filling.clear();
+            filling.reserve(buffer_states);
+            runs.push_back(run_path());
+            pending = async(launch::async, [this, &flushing, path = runs.back()] {
+                sort(flushing.begin(), flushing.end());
+                flushing.erase(unique(flushing.begin(), flushing.end()), flushing.end());
+                RunWriter w(path, block_size);
+                for(uint64_t s : flushing) w.put(s);
+                if(!w.close()) throw runtime_error("write to " + path + " failed");
+                return w.bytes();
+            });
+        };
+        
+        RunReader in(layer_path(d), block_size);
+        for(; !in.done(); in.advance()) {
+            uint64_t s = in.value();
+            int blank = 0;
+            while((s >> (4 * blank)) & 15) blank++;
+            expanded++;
+            generated += neighbors[blank].size();
+            INSTR_COUNT(NODES_EXPANDED);
+            INSTR_ADD(NODES_GENERATED, neighbors[blank].size());
+            for(int q : neighbors[blank]) {
+                uint64_t tile = (s >> (4 * q)) & 15;
+                filling.push_back(s + (tile << (4 * blank)) - (tile << (4 * q)));
+                if(filling.size() == buffer_states) spill();
+            }
+        }
+        bytes_read += in.bytes();
+        if(!filling.empty()) spill();
+        if(pending.valid()) bytes_written += pending.get();
+        return runs;
+    }
+    
+    // Moves reader up to s; true if s is in its file.
+    static bool seen_in(RunReader& reader, uint64_t s) {
+        while(!reader.done() && reader.value() < s) reader.advance();
+        return !reader.done() && reader.value() == s;
+    }
+    
+    // Calls emit on the union of the runs, in order and without repeats. If there
+    // are more runs than blocks fit in memory, groups of them are merged into
+    // bigger runs first; runs is left naming the files that were merged last.
+    void merge(vector<string>& runs, const function<void(uint64_t)>& emit) {
+        while(runs.size() > max_fan_in) {
+            vector<string> group(runs.begin(), runs.begin() + max_fan_in);
+            runs.erase(runs.begin(), runs.begin() + max_fan_in);
+            runs.push_back(run_path());
+            RunWriter w(runs.back(), block_size);
+            merge_once(group, [&](uint64_t s) { w.put(s); });
+            finish(w);
+            for(const string& path : group) std::remove(path.c_str());
+        }
+        merge_once(runs, emit);
+    }
+    
+    void merge_once(const vector<string>& runs, const function<void(uint64_t)>& emit) {
+        vector<unique_ptr<RunReader>> readers;
+        using Head = pair<uint64_t, int>;
+        priority_queue<Head, vector<Head>, greater<Head>> heads;
+        for(const string& path : runs) {
+            readers.emplace_back(new RunReader(path, block_size));
+            if(!readers.back()->done()) heads.push({readers.back()->value(), (int)readers.size() - 1});
+        }
+        bool any = false;
+        uint64_t last = 0;
+        while(!heads.empty()) {
+            auto [s, i] = heads.top();
+            heads.pop();
+            if(!any || s != last) emit(s);
+            any = true;
+            last = s;
+            readers[i]->advance();
+            if(!readers[i]->done()) heads.push({readers[i]->value(), i});
+        }
+        for(auto& r : readers) bytes_read += r->bytes();
+    }
+};
+
 class PuzzleSolver {
 private:
     State initial;
@@ -91,6 +414,80 @@ private:
         return neighbors;
     }
     
+    // One mutable board for dfs and iddfs: moves are applied and undone on
+    // it instead of copying states, and only the current path is kept.
+    struct Board {
+        int cell[9];
+        int blank;
+        int misplaced;  // cells not holding their goal tile; 0 at the goal
+        string path;    // moves from the start to here
+    };
+    
+    // Moves the blank to cell `to`, keeping misplaced up to date.
+    static void slide(Board& b, int to) {
+        int from = b.blank, tile = b.cell[to];
+        b.misplaced -= (b.cell[from] != from) + (tile != to);
+        b.cell[from] = tile;
+        b.cell[to] = 0;
+        b.blank = to;
+        b.misplaced += (tile != from) + (to != 0);
+    }
+    
+    Board start_board() const {
+        Board b;
+        b.blank = initial.blank_pos;
+        b.misplaced = 0;
+        for(int i = 0; i < 9; i++) {
+            b.cell[i] = initial.board[i];
+            b.misplaced += b.cell[i] != i;
+        }
+        return b;
+    }
+    
+    // Cells the blank can move to from each cell, with the move's name, in the
+    // current move order.
+    vector<vector<pair<int,char>>> blank_moves() const {
+        vector<vector<pair<int,char>>> table(9);
+        for(int pos = 0; pos < 9; pos++)
+            for(auto [dr, dc, move_char] : moves) {
+                int new_row = pos / 3 + dr, new_col = pos % 3 + dc;
+                if(new_row >= 0 && new_row < 3 && new_col >= 0 && new_col < 3)
+                    table[pos].push_back({new_row * 3 + new_col, move_char});
+            }
+        return table;
+    }
+    
+    // Depth-first below the current board, at most limit moves from the start.
+    // prev_blank is where the blank just came from: moving it back would only undo
+    // the last move, so that child is skipped. Leaves b at the goal on success.
+    // The caller flushes tally.
+    bool descend(Board& b, int limit, int prev_blank, const vector<vector<pair<int,char>>>& table, Metrics& m,
+                 instr::Tally& tally) {
+        int depth = b.path.size();
+        m.nodes_expanded++;
+        tally.add(instr::NODES_EXPANDED);
+        m.max_depth = max(m.max_depth, depth);
+        if(b.misplaced == 0) return true;
+        if(depth >= limit) {
+            tally.add(instr::PRUNED);
+            return false;
+        }
+        
+        int from = b.blank;
+        for(auto [to, move_char] : table[from]) {
+            if(to == prev_blank) continue;
+            m.nodes_generated++;
+            tally.add(instr::NODES_GENERATED);
+            slide(b, to);
+            b.path.push_back(move_char);
+            if(descend(b, limit, from, table, m, tally)) return true;
+            b.path.pop_back();
+            slide(b, from);
+            tally.add(instr::BACKTRACKS);
+        }
+        return false;
+    }
+    
 public:
     PuzzleSolver(const State& start) : initial(start) {
         set_move_order("UDLR"); // Default: Up, Down, Left, Right
@@ -108,44 +505,19 @@ public:
         }
     }
     
-    // DFS with depth limit
+    // Depth-limited DFS over one board, without a visited set: memory is the path.
+    // Without duplicate detection it can revisit states by other routes, but each
+    // node costs a move and its undo rather than a copied state.
     Metrics dfs(int max_depth = 31) {
         Metrics m;
         auto start_time = high_resolution_clock::now();
         
-        unordered_set<string> visited;
-        vector<State> stack;
-        stack.push_back(initial);
-        
-        while(!stack.empty()) {
-            State curr = stack.back();
-            stack.pop_back();
-            
-            string key = curr.serialize();
-            if(visited.count(key)) continue;
-            visited.insert(key);
-            
-            m.nodes_expanded++;
-            m.max_depth = max(m.max_depth, curr.depth);
-            
-            if(curr.is_goal()) {
-                m.solved = true;
-                m.solution_length = curr.path.length();
-                m.time_ms = duration<double, milli>(high_resolution_clock::now() - start_time).count();
-                return m;
-            }
-            
-            if(curr.depth >= max_depth) continue;
-            
-            vector<State> neighbors = get_neighbors(curr);
-            m.nodes_generated += neighbors.size();
-            
-            // Push in reverse for correct DFS order
-            for(int i = neighbors.size()-1; i >= 0; i--) {
-                if(!visited.count(neighbors[i].serialize()))
-                    stack.push_back(neighbors[i]);
-            }
-        }
+        Board b = start_board();
+        b.path.reserve(max_depth);
+        instr::Tally tally;
+        m.solved = descend(b, max_depth, -1, blank_moves(), m, tally);
+        tally.flush();
+        if(m.solved) m.solution_length = b.path.length();
         
         m.time_ms = duration<double, milli>(high_resolution_clock::now() - start_time).count();
         return m;
@@ -166,6 +538,7 @@ public:
             q.pop();
             
             m.nodes_expanded++;
+            INSTR_COUNT(NODES_EXPANDED);
             m.max_depth = max(m.max_depth, curr.depth);
             
             if(curr.is_goal()) {
@@ -177,6 +550,7 @@ public:
             
             vector<State> neighbors = get_neighbors(curr);
             m.nodes_generated += neighbors.size();
+            INSTR_ADD(NODES_GENERATED, neighbors.size());
             
             for(const State& next : neighbors) {
                 string key = next.serialize();
@@ -191,45 +565,40 @@ public:
         return m;
     }
     
-    // Iterative Deepening DFS - combines DFS memory efficiency with BFS completeness
+    // BFS with the layers on disk (see ExternalBFS). Finds the solution length but
+    // not the moves: no parent pointers are kept.
+    Metrics external_bfs(size_t memory_bytes = size_t(64) << 20, const string& dir = ".") {
+        Metrics m;
+        auto start_time = high_resolution_clock::now();
+        
+        ExternalBFS search(3, 3, memory_bytes, dir);
+        int depth = search.run(ExternalBFS::pack(initial.board), ExternalBFS::pack(goal));
+        m.nodes_expanded = search.states_expanded();
+        m.nodes_generated = search.states_generated();
+        m.max_depth = search.layer_sizes().size() - 1;
+        m.solved = depth >= 0;
+        m.solution_length = max(depth, 0);
+        
+        m.time_ms = duration<double, milli>(high_resolution_clock::now() - start_time).count();
+        return m;
+    }
+    
+    // Iterative Deepening DFS - combines DFS memory efficiency with BFS completeness.
+    // Each round is dfs's in-place search, so a shortest solution is found in
+    // O(depth) memory.
     Metrics iddfs(int max_limit = 31) {
         Metrics m;
         auto start_time = high_resolution_clock::now();
         
-        for(int limit = 0; limit <= max_limit; limit++) {
-            unordered_set<string> visited;
-            vector<State> stack;
-            stack.push_back(initial);
-            
-            while(!stack.empty()) {
-                State curr = stack.back();
-                stack.pop_back();
-                
-                string key = curr.serialize();
-                if(visited.count(key)) continue;
-                visited.insert(key);
-                
-                m.nodes_expanded++;
-                m.max_depth = max(m.max_depth, curr.depth);
-                
-                if(curr.is_goal()) {
-                    m.solved = true;
-                    m.solution_length = curr.path.length();
-                    m.time_ms = duration<double, milli>(high_resolution_clock::now() - start_time).count();
-                    return m;
-                }
-                
-                if(curr.depth >= limit) continue;
-                
-                vector<State> neighbors = get_neighbors(curr);
-                m.nodes_generated += neighbors.size();
-                
-                for(int i = neighbors.size()-1; i >= 0; i--) {
-                    if(!visited.count(neighbors[i].serialize()))
-                        stack.push_back(neighbors[i]);
-                }
-            }
+        vector<vector<pair<int,char>>> table = blank_moves();
+        instr::Tally tally;
+        for(int limit = 0; limit <= max_limit && !m.solved; limit++) {
+            Board b = start_board();
+            b.path.reserve(limit);
+            m.solved = descend(b, limit, -1, table, m, tally);
+            if(m.solved) m.solution_length = b.path.length();
         }
+        tally.flush();
         
         m.time_ms = duration<double, milli>(high_resolution_clock::now() - start_time).count();
         return m;
@@ -269,7 +638,7 @@ void move_ordering_experiment(const State& start) {
     }
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     // Test cases
     vector<vector<int>> test_cases = {
         {1,2,3,4,5,6,7,8,0},  // Easy: 0 moves
@@ -279,6 +648,69 @@ int main() {
         {8,6,7,2,5,4,3,0,1}   // Hard: 31 moves (near worst case)
     };
     
+    // Full sweep from the goal with the layers on disk:
+    // --external-bfs [rows=3] [cols=3] [memory MiB=64] [dir=.] [max depth]
+    if(argc >= 2 && string(argv[1]) == "--external-bfs") {
+        int rows = argc >= 3 ? atoi(argv[2]) : 3, cols = argc >= 4 ? atoi(argv[3]) : 3;
+        size_t memory = size_t(argc >= 5 ? atof(argv[4]) * (1 << 20) : 64 << 20);
+        string dir = argc >= 6 ? argv[5] : ".";
+        int max_depth = argc >= 7 ? atoi(argv[6]) : INT32_MAX;
+        if(rows < 1 || cols < 1 || rows * cols > 16 || rows * cols < 2) {
+            cout << "The board must have 2 to 16 cells.\n";
+            return 1;
+        }
+        vector<int> board(rows * cols);
+        for(int i = 0; i < rows * cols; i++) board[i] = i;
+        try {
+            auto start_time = high_resolution_clock::now();
+            ExternalBFS search(rows, cols, memory, dir);
+            search.run(ExternalBFS::pack(board), ExternalBFS::NO_TARGET, max_depth);
+            double seconds = duration<double>(high_resolution_clock::now() - start_time).count();
+            
+            const vector<uint64_t>& layers = search.layer_sizes();
+            uint64_t total = 0;
+            cout << "Depth | States\n";
+            for(int d = 0; d < (int)layers.size(); d++) {
+                if(layers[d] == 0) break;
+                cout << setw(5) << d << " | " << layers[d] << "\n";
+                total += layers[d];
+            }
+            int deepest = layers.back() ? layers.size() - 1 : layers.size() - 2;
+            cout << rows << "x" << cols << ": " << total << " states, "
+                 << (layers.back() ? "searched to depth " : "diameter from the goal ") << deepest << "\n";
+            cout << "Disk: " << search.disk_bytes_written() / 1e6 << " MB written, " << search.disk_bytes_read() / 1e6
+                 << " MB read (" << fixed << setprecision(2) << 8.0 * search.disk_bytes_written() / max<uint64_t>(total, 1)
+                 << " bits per state written); " << seconds << " s, " << setprecision(0)
+                 << search.states_expanded() / seconds << " states/s\n";
+        } catch(const exception& e) {
+            cout << "External BFS failed: " << e.what() << "\n";
+            return 1;
+        }
+        return 0;
+    }
+    
+    // One JSON line per algorithm and test case, in the schema of instrumentation.h
+    // (build with -DINSTRUMENTATION=1 for the work counters)
+    if(argc >= 2 && string(argv[1]) == "--json") {
+        for(int tc = 0; tc < (int)test_cases.size(); tc++) {
+            if(!is_solvable(test_cases[tc])) continue;
+            PuzzleSolver solver{State(test_cases[tc])};
+            string instance = "test case " + to_string(tc + 1);
+            vector<pair<string, function<Metrics()>>> algos = {
+                {"dfs", [&] { return solver.dfs(31); }},
+                {"bfs", [&] { return solver.bfs(); }},
+                {"iddfs", [&] { return solver.iddfs(31); }},
+                {"external-bfs", [&] { return solver.external_bfs(); }}};
+            for(auto& [algo, search] : algos) {
+                instr::Run run("8-puzzle " + algo, instance);
+                Metrics m = search();
+                run.extra("solved", m.solved).extra("solution_length", m.solution_length).extra("max_depth", m.max_depth);
+                cout << run.finish() << "\n";
+            }
+        }
+        return 0;
+    }
+    
     for(int tc = 0; tc < test_cases.size(); tc++) {
         if(!is_solvable(test_cases[tc])) {
             cout << "Test case " << tc+1 << " is not solvable!\n";
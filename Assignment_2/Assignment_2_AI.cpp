@@ -1,5 +1,11 @@
 #include <iostream>
 #include <vector>
+#include <string>
+#include <chrono>
+#include <iomanip>
+#include <fstream>
+#include <cctype>
+#include "../common/instrumentation.h"
 using namespace std;
 const int N = 9;
 
@@ -73,12 +79,13 @@ bool solveSudoku(int grid[N][N]) {
         return true;
     }
 
-    
+    INSTR_COUNT(NODES_EXPANDED);
     for (int num = 1; num <= 9; ++num) {
         
         if (isSafe(grid, row, col, num)) {
             
             grid[row][col] = num;
+            INSTR_COUNT(NODES_GENERATED);
 
             if (solveSudoku(grid)) {
                 return true; 
@@ -86,15 +93,485 @@ bool solveSudoku(int grid[N][N]) {
 
            
             grid[row][col] = 0;
+            INSTR_COUNT(BACKTRACKS);
+        } else {
+            INSTR_COUNT(PRUNED);
+        }
+    }
+
+    return false;
+}
+
+// ---------------------------------------------------------------------------
+// Deduction ahead of the search
+// ---------------------------------------------------------------------------
+// Cells are numbered 0..80 row by row. A unit is a row, a column or a box; the
+// peers of a cell are the 20 other cells sharing a unit with it.
+
+struct SudokuTables {
+    int units[27][N];       // rows 0..8, columns 9..17, boxes 18..26
+    int unitsOf[N * N][3];  // row, column and box of each cell
+    int peers[N * N][20];
+
+    SudokuTables() {
+        for (int i = 0; i < N; ++i)
+            for (int j = 0; j < N; ++j) {
+                units[i][j] = i * N + j;
+                units[N + i][j] = j * N + i;
+                units[2 * N + i][j] = (i / 3 * 3 + j / 3) * N + i % 3 * 3 + j % 3;
+            }
+        for (int u = 0; u < 27; ++u)
+            for (int cell : units[u]) unitsOf[cell][u / N] = u;
+        for (int cell = 0; cell < N * N; ++cell) {
+            int count = 0;
+            for (int other = 0; other < N * N; ++other) {
+                if (other == cell) continue;
+                bool shared = false;
+                for (int k = 0; k < 3; ++k) shared = shared || unitsOf[other][k] == unitsOf[cell][k];
+                if (shared) peers[cell][count++] = other;
+            }
+        }
+    }
+};
+
+const SudokuTables TABLES;
+
+// The digits still possible in each cell, as bits 1..9. A placed cell has a single
+// bit and has had its digit removed from all its peers.
+struct Candidates {
+    unsigned short mask[N * N];
+    bool placed[N * N];
+    long changes = 0;       // candidates removed so far; rules compare it before and after
+    bool broken = false;    // a cell or a unit has no way left to hold some digit
+
+    explicit Candidates(int grid[N][N]) {
+        for (int cell = 0; cell < N * N; ++cell) {
+            mask[cell] = 0x3FE;
+            placed[cell] = false;
+        }
+        for (int cell = 0; cell < N * N && !broken; ++cell) {
+            int digit = grid[cell / N][cell % N];
+            if (digit >= 1 && digit <= 9) place(cell, digit);
+        }
+    }
+
+    bool solved() const {
+        for (int cell = 0; cell < N * N; ++cell)
+            if (!placed[cell]) return false;
+        return true;
+    }
+
+    void eliminate(int cell, int digit) {
+        if (!(mask[cell] >> digit & 1)) return;
+        mask[cell] &= ~(1 << digit);
+        ++changes;
+        if (!mask[cell]) broken = true;
+    }
+
+    // Keeps only the digits in keep.
+    void restrict(int cell, unsigned short keep) {
+        for (int digit = 1; digit <= 9; ++digit)
+            if (!(keep >> digit & 1)) eliminate(cell, digit);
+    }
+
+    void place(int cell, int digit) {
+        if (placed[cell]) {
+            if (mask[cell] != 1 << digit) broken = true;
+            return;
+        }
+        restrict(cell, 1 << digit);
+        if (broken) return;
+        placed[cell] = true;
+        ++changes;
+        for (int peer : TABLES.peers[cell]) eliminate(peer, digit);
+    }
+
+    // Cells of unit u where digit is still possible, as bits 0..8 of the unit.
+    unsigned short positions(int u, int digit) const {
+        unsigned short where = 0;
+        for (int i = 0; i < N; ++i)
+            if (mask[TABLES.units[u][i]] >> digit & 1) where |= 1 << i;
+        return where;
+    }
+};
+
+// Naked single: a cell with one candidate left holds it.
+void nakedSingles(Candidates& c) {
+    for (int cell = 0; cell < N * N && !c.broken; ++cell)
+        if (!c.placed[cell] && __builtin_popcount(c.mask[cell]) == 1) c.place(cell, __builtin_ctz(c.mask[cell]));
+}
+
+// Hidden single: a digit with one cell left in a unit goes there.
+void hiddenSingles(Candidates& c) {
+    for (int u = 0; u < 27 && !c.broken; ++u)
+        for (int digit = 1; digit <= 9 && !c.broken; ++digit) {
+            unsigned short where = c.positions(u, digit);
+            if (!where) c.broken = true;
+            else if (__builtin_popcount(where) == 1) c.place(TABLES.units[u][__builtin_ctz(where)], digit);
+        }
+}
+
+// Calls visit with every k-element subset of items (as an index bitmask) whose
+// masks together have at most k bits.
+template <typename Visit>
+void smallUnions(const int* items, const unsigned short* masks, int count, int k, Visit visit, int from = 0,
+                 int chosen = 0, unsigned short together = 0) {
+    if (__builtin_popcount(chosen) == k) {
+        visit(chosen, together);
+        return;
+    }
+    for (int i = from; i < count; ++i) {
+        unsigned short next = together | masks[i];
+        if (__builtin_popcount(next) <= k) smallUnions(items, masks, count, k, visit, i + 1, chosen | 1 << items[i], next);
+    }
+}
+
+// Naked subset: k open cells of a unit whose candidates together are k digits
+// take those digits, so the rest of the unit cannot have them.
+void nakedSubsets(Candidates& c, int k) {
+    for (int u = 0; u < 27 && !c.broken; ++u) {
+        const int* unit = TABLES.units[u];
+        int items[N], count = 0;
+        unsigned short masks[N];
+        for (int i = 0; i < N; ++i)
+            if (!c.placed[unit[i]]) {
+                items[count] = i;
+                masks[count++] = c.mask[unit[i]];
+            }
+        if (count <= k) continue;
+        smallUnions(items, masks, count, k, [&](int cells, unsigned short digits) {
+            if (__builtin_popcount(digits) < k) {
+                c.broken = true;
+                return;
+            }
+            for (int i = 0; i < N; ++i)
+                if (!(cells >> i & 1) && !c.placed[unit[i]]) c.restrict(unit[i], ~digits);
+        });
+    }
+}
+
+// Hidden subset: k digits that fit in only k cells of a unit fill those cells, so
+// the cells cannot hold anything else.
+void hiddenSubsets(Candidates& c, int k) {
+    for (int u = 0; u < 27 && !c.broken; ++u) {
+        const int* unit = TABLES.units[u];
+        unsigned short done = 0;    // digits already placed in the unit
+        for (int i = 0; i < N; ++i)
+            if (c.placed[unit[i]]) done |= c.mask[unit[i]];
+        int items[N], count = 0;
+        unsigned short masks[N];
+        for (int digit = 1; digit <= 9; ++digit)
+            if (!(done >> digit & 1)) {
+                items[count] = digit;
+                masks[count++] = c.positions(u, digit);
+            }
+        if (count <= k) continue;
+        smallUnions(items, masks, count, k, [&](int digits, unsigned short cells) {
+            if (__builtin_popcount(cells) < k) {
+                c.broken = true;
+                return;
+            }
+            for (int i = 0; i < N; ++i)
+                if (cells >> i & 1) c.restrict(unit[i], digits);
+        });
+    }
+}
+
+void nakedPairs(Candidates& c) { nakedSubsets(c, 2); }
+void nakedTriples(Candidates& c) { nakedSubsets(c, 3); }
+void hiddenPairs(Candidates& c) { hiddenSubsets(c, 2); }
+void hiddenTriples(Candidates& c) { hiddenSubsets(c, 3); }
+
+// Pointing: if a digit's cells in a box all lie on one row or column, the digit is
+// in that part of the line, so the rest of the line loses it. Claiming is the same
+// the other way round, from a line into a box.
+void lockedCandidates(Candidates& c) {
+    for (int digit = 1; digit <= 9 && !c.broken; ++digit)
+        for (int a = 0; a < 27; ++a) {
+            unsigned short where = c.positions(a, digit);
+            if (__builtin_popcount(where) < 2) continue;
+            // The other unit every cell of a shares, if there is one.
+            for (int kind = 0; kind < 3; ++kind) {
+                int b = TABLES.unitsOf[TABLES.units[a][__builtin_ctz(where)]][kind];
+                if (b == a) continue;
+                bool inside = true;
+                for (int i = 0; i < N; ++i)
+                    if (where >> i & 1) inside = inside && TABLES.unitsOf[TABLES.units[a][i]][kind] == b;
+                if (!inside) continue;
+                for (int cell : TABLES.units[b]) {
+                    bool inA = TABLES.unitsOf[cell][a / N] == a;
+                    if (!inA) c.eliminate(cell, digit);
+                }
+            }
+        }
+}
+
+// X-Wing: if a digit fits in exactly the same two columns in two rows, it is in
+// those columns in those rows, so the other rows lose it in both columns. Likewise
+// with rows and columns swapped.
+void xWing(Candidates& c) {
+    for (int digit = 1; digit <= 9 && !c.broken; ++digit)
+        for (int base = 0; base <= N; base += N) {     // rows, then columns
+            unsigned short where[N];
+            for (int i = 0; i < N; ++i) where[i] = c.positions(base + i, digit);
+            for (int i = 0; i < N; ++i) {
+                if (__builtin_popcount(where[i]) != 2) continue;
+                for (int j = i + 1; j < N; ++j) {
+                    if (where[j] != where[i]) continue;
+                    int cover = N - base;               // the crossing lines
+                    for (int x = 0; x < N; ++x) {
+                        if (!(where[i] >> x & 1)) continue;
+                        for (int y = 0; y < N; ++y)
+                            if (y != i && y != j) c.eliminate(TABLES.units[cover + x][y], digit);
+                    }
+                }
+            }
+        }
+}
+
+struct DeductionRule {
+    const char* name;
+    void (*pass)(Candidates&);
+    bool enabled = true;
+    long long calls = 0, fired = 0, changes = 0;
+    double seconds = 0;
+};
+
+// The deduction rules, cheapest first, each run as one pass over the candidates.
+// propagate() runs the enabled ones to a fixpoint: whenever a rule changes
+// something, it starts over from the cheapest. Every rule keeps how often it ran,
+// how often it changed something, how many candidates it removed and its time.
+class DeductionPipeline {
+public:
+    vector<DeductionRule> rules = {
+        {"naked singles", nakedSingles}, {"hidden singles", hiddenSingles},
+        {"naked pairs", nakedPairs},     {"pointing/claiming", lockedCandidates},
+        {"hidden pairs", hiddenPairs},   {"naked triples", nakedTriples},
+        {"hidden triples", hiddenTriples}, {"x-wing", xWing}};
+
+    // Enables the rules named in a comma-separated list ("all" for every rule,
+    // "none" for none); returns false if a name is unknown.
+    bool configure(const string& names) {
+        for (DeductionRule& rule : rules) rule.enabled = names == "all";
+        if (names == "all" || names == "none") return true;
+        size_t start = 0;
+        while (start <= names.size()) {
+            size_t end = names.find(',', start);
+            if (end == string::npos) end = names.size();
+            string name = names.substr(start, end - start);
+            bool known = false;
+            for (DeductionRule& rule : rules)
+                if (name == rule.name) known = rule.enabled = true;
+            if (!known) return false;
+            start = end + 1;
+        }
+        return true;
+    }
+
+    // False if the candidates turn out to be contradictory.
+    bool propagate(Candidates& c) {
+        for (size_t i = 0; i < rules.size() && !c.broken;) {
+            DeductionRule& rule = rules[i];
+            if (!rule.enabled) {
+                ++i;
+                continue;
+            }
+            long before = c.changes;
+            {
+                instr::ScopedTimer timer(rule.seconds);
+                rule.pass(c);
+            }
+            ++rule.calls;
+            if (c.changes == before) {
+                ++i;
+                continue;
+            }
+            ++rule.fired;
+            rule.changes += c.changes - before;
+            INSTR_COUNT(RULES_FIRED);
+            INSTR_ADD(FACTS_DERIVED, c.changes - before);
+            i = 0;
         }
+        return !c.broken;
+    }
+
+    void resetStatistics() {
+        for (DeductionRule& rule : rules) rule.calls = rule.fired = rule.changes = 0, rule.seconds = 0;
     }
 
+    void printStatistics(ostream& out) const {
+        out << "rule                 calls     fired   removed   time (ms)  us/call\n";
+        for (const DeductionRule& rule : rules) {
+            if (!rule.enabled) continue;
+            out << left << setw(18) << rule.name << right << setw(8) << rule.calls << setw(10) << rule.fired
+                << setw(10) << rule.changes << setw(12) << fixed << setprecision(2) << rule.seconds * 1e3
+                << setw(9) << (rule.calls ? rule.seconds * 1e6 / rule.calls : 0) << "\n";
+        }
+    }
+};
+
+// Backtracking over the candidates: deduce to a fixpoint, then branch on the open
+// cell with the fewest candidates, deducing again after every guess. nodes counts
+// the branch points.
+bool searchCandidates(Candidates& c, DeductionPipeline& pipeline, long long& nodes) {
+    if (!pipeline.propagate(c)) return false;
+    int best = -1;
+    for (int cell = 0; cell < N * N; ++cell) {
+        if (c.placed[cell]) continue;
+        if (best < 0 || __builtin_popcount(c.mask[cell]) < __builtin_popcount(c.mask[best])) best = cell;
+    }
+    if (best < 0) return true;
+
+    ++nodes;
+    INSTR_COUNT(NODES_EXPANDED);
+    for (int digit = 1; digit <= 9; ++digit) {
+        if (!(c.mask[best] >> digit & 1)) continue;
+        Candidates guess = c;
+        INSTR_COUNT(NODES_GENERATED);
+        guess.place(best, digit);
+        if (!guess.broken && searchCandidates(guess, pipeline, nodes)) {
+            c = guess;
+            return true;
+        }
+        INSTR_COUNT(BACKTRACKS);
+    }
     return false;
 }
 
-int main() {
+// solveSudoku with the deduction pipeline ahead of every branch. Fills grid and
+// returns true if the puzzle has a solution.
+bool solveSudokuDeductive(int grid[N][N], DeductionPipeline& pipeline, long long* branchNodes = nullptr) {
+    Candidates c(grid);
+    long long nodes = 0;
+    bool solved = !c.broken && searchCandidates(c, pipeline, nodes);
+    if (branchNodes) *branchNodes = nodes;
+    if (!solved) return false;
+    for (int cell = 0; cell < N * N; ++cell) grid[cell / N][cell % N] = __builtin_ctz(c.mask[cell]);
+    return true;
+}
+
+// True if grid is a complete, valid solution that keeps the givens of puzzle.
+bool isSolutionOf(int grid[N][N], const string& puzzle) {
+    for (int cell = 0; cell < N * N; ++cell) {
+        int v = grid[cell / N][cell % N];
+        if (v < 1 || v > 9) return false;
+        if (isdigit(puzzle[cell]) && puzzle[cell] != '0' && puzzle[cell] - '0' != v) return false;
+        for (int peer : TABLES.peers[cell])
+            if (grid[peer / N][peer % N] == v) return false;
+    }
+    return true;
+}
+
+// Hard puzzles used when no corpus file is given.
+const vector<string> HARD_PUZZLES = {
+    "800000000003600000070090200050007000000045700000100030001000068008500010090000400",
+    "4.....8.5.3..........7......2.....6.....8.4......1.......6.3.7.5..2.....1.4......",
+    "85...24..72......9..4.........1.7..23.5...9...4...........8..7..17..........36.4.",
+    "..53.....8......2..7..1.5..4....53...1..7...6..32...8..6.5....9..4....3......97..",
+    "12..4......5.69.1...9...5.........7.7...52.9..3......2.9.6...5.4..9..8.1..3...9.4",
+    "...57..3.1......2.7...234......8...4..7..4...49....6.5.42...3.....7..9....18.....",
+    "7..1523........92....3.....1....47.8.......6............9...5.6.4.9.7...8....6.1.",
+    "1....7.9..3..2...8..96..5....53..9...1..8...26....4...3......1..4......7..7...3..",
+    "1...34.8....8..5....4.6..21.18......3..1.2..6......81.52..7.9....6..9....9.64...2",
+    "...92......68.3...19..7...623..4.1....1...7....8.3..297...8..91...5.72......64...",
+    ".6.5.4.3.1...9...8.........9...5...6.4.6.2.7.7...4...5.........4...8...1.5.2.3.4.",
+    "7.....4...2..7..8...3..8.799..5..3...6..2..9...1.97..6...3..9...3..4..6...9..1.35",
+    "....7..2.8.......6.1.2.5...9.54....8.........3....85.1...3.2.8.4.......9.7..6....",
+    "1.......2.9.4...5...6...7...5.9.3.......7.......85..4.7.....6...3...9.8...2.....1",
+};
+
+void loadPuzzle(const string& puzzle, int grid[N][N]) {
+    for (int cell = 0; cell < N * N; ++cell)
+        grid[cell / N][cell % N] = isdigit(puzzle[cell]) ? puzzle[cell] - '0' : 0;
+}
+
+// Solves every puzzle of the corpus with each rule set and prints the total time and
+// branch points, then the per-rule statistics of the last set. Without a rule list,
+// compares a ladder of sets from no deduction to every rule.
+void deductionBenchmark(const vector<string>& corpus, const string& ruleList) {
+    vector<string> sets = {"none", "naked singles", "naked singles,hidden singles",
+                           "naked singles,hidden singles,naked pairs,pointing/claiming",
+                           "naked singles,hidden singles,naked pairs,pointing/claiming,hidden pairs,naked triples,"
+                           "hidden triples",
+                           "all"};
+    if (!ruleList.empty()) sets = {ruleList};
+
+    DeductionPipeline pipeline;
+    for (const string& names : sets)
+        if (!pipeline.configure(names)) {
+            cout << "Unknown rule in \"" << names << "\"\n";
+            return;
+        }
+    cout << corpus.size() << " puzzles\n";
+    cout << "rules                                     time (ms)  branch points  solved\n";
+    for (const string& names : sets) {
+        pipeline.configure(names);
+        pipeline.resetStatistics();
+        long long nodes = 0;
+        int solved = 0;
+        auto start = chrono::steady_clock::now();
+        for (const string& puzzle : corpus) {
+            int grid[N][N];
+            loadPuzzle(puzzle, grid);
+            long long branchNodes = 0;
+            if (solveSudokuDeductive(grid, pipeline, &branchNodes) && isSolutionOf(grid, puzzle)) ++solved;
+            nodes += branchNodes;
+        }
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        string label = names.size() > 40 ? names.substr(0, 37) + "..." : names;
+        cout << left << setw(40) << label << right << setw(12) << fixed << setprecision(2) << ms << setw(15) << nodes
+             << setw(8) << solved << "\n";
+    }
+    cout << "\n";
+    pipeline.printStatistics(cout);
+}
+
+int main(int argc, char* argv[]) {
     int grid[N][N];
 
+    // "--deduce [corpus file] [rules]": the corpus has one puzzle per line, 81
+    // characters with '0' or '.' for blanks; rules is a comma-separated list of names
+    // (see DeductionPipeline) or "all".
+    if (argc >= 2 && string(argv[1]) == "--deduce") {
+        vector<string> corpus = HARD_PUZZLES;
+        if (argc >= 3 && string(argv[2]) != "-") {
+            ifstream in(argv[2]);
+            if (!in) {
+                cout << "Cannot open " << argv[2] << "\n";
+                return 1;
+            }
+            corpus.clear();
+            for (string line; getline(in, line);) {
+                string puzzle;
+                for (char ch : line)
+                    if (isdigit(ch) || ch == '.') puzzle += ch;
+                if (puzzle.size() == N * N) corpus.push_back(puzzle);
+            }
+        }
+        deductionBenchmark(corpus, argc >= 4 ? argv[3] : "");
+        return 0;
+    }
+
+    // Solve a built-in hard puzzle and print one JSON line per solver (schema in
+    // instrumentation.h; build with -DINSTRUMENTATION=1 for the work counters).
+    if (argc >= 2 && string(argv[1]) == "--json") {
+        const char* puzzle = "800000000003600000070090200050007000000045700000100030001000068008500010090000400";
+        for (int i = 0; i < N * N; ++i) grid[i / N][i % N] = puzzle[i] - '0';
+        instr::Run run("sudoku backtracking", puzzle);
+        bool solved = solveSudoku(grid);
+        run.extra("solved", solved);
+        cout << run.finish() << "\n";
+
+        loadPuzzle(puzzle, grid);
+        DeductionPipeline pipeline;
+        long long branchNodes = 0;
+        instr::Run deductive("sudoku deduction + backtracking", puzzle);
+        solved = solveSudokuDeductive(grid, pipeline, &branchNodes);
+        deductive.extra("solved", solved).extra("branch_points", branchNodes);
+        cout << deductive.finish() << "\n";
+        return 0;
+    }
+
     cout << "🔢 Welcome to the Sudoku Solver! 🔢\n";
     cout << "Please enter the Sudoku puzzle row by row.\n";
     cout << "Use '0' for empty cells and separate numbers with spaces.\n\n";
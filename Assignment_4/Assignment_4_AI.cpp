@@ -5,6 +5,14 @@
 #include <stack>
 #include <limits>
 #include <tuple>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include "../common/instrumentation.h"
 using namespace std;
 
 struct Cell {
@@ -33,6 +41,12 @@ bool isDestination(int row, int col, const pair<int, int>& dest) {
 }
 
 
+// 8-connected moves shared by every search over the grid: 4 straight, 4 diagonal.
+const int DX[] = {-1, 1, 0, 0, -1, -1, 1, 1};
+const int DY[] = {0, 0, 1, -1, 1, -1, 1, -1};
+const double MOVE_COST[] = {1.0, 1.0, 1.0, 1.0, 1.414, 1.414, 1.414, 1.414};
+
+
 double calculateHValue(int row, int col, const pair<int, int>& dest) {
     return abs(row - dest.first) + abs(col - dest.second);
 }
@@ -63,33 +77,14 @@ void tracePath(const vector<vector<Cell>>& cellDetails, const pair<int, int>& de
 }
 
 
-void aStarSearch(const vector<vector<int>>& grid, const pair<int, int>& src, const pair<int, int>& dest) {
+// Core A* loop. Fills cellDetails and returns true once dest is reached.
+// Assumes src and dest are valid, unblocked and distinct.
+bool aStarCore(const vector<vector<int>>& grid, const pair<int, int>& src, const pair<int, int>& dest,
+               vector<vector<Cell>>& cellDetails) {
     int ROW = grid.size();
     int COL = grid[0].size();
-    
-    
-    if (!isValid(src.first, src.second, ROW, COL) || !isValid(dest.first, dest.second, ROW, COL)) {
-        cout << "Source or Destination is invalid\n";
-        return;
-    }
 
-    
-    if (!isUnblocked(grid, src.first, src.second) || !isUnblocked(grid, dest.first, dest.second)) {
-        cout << "Source or the destination is blocked\n";
-        return;
-    }
-
-    
-    if (isDestination(src.first, src.second, dest)) {
-        cout << "We are already at the destination\n";
-        return;
-    }
-    
-    
     vector<vector<bool>> closedList(ROW, vector<bool>(COL, false));
-    
-    
-    vector<vector<Cell>> cellDetails(ROW, vector<Cell>(COL));
 
     int i, j;
     i = src.first, j = src.second;
@@ -112,30 +107,25 @@ void aStarSearch(const vector<vector<int>>& grid, const pair<int, int>& src, con
 
         
         closedList[x][y] = true;
-
-        
-        int dx[] = {-1, 1, 0, 0, -1, -1, 1, 1};
-        int dy[] = {0, 0, 1, -1, 1, -1, 1, -1};
-        double cost[] = {1.0, 1.0, 1.0, 1.0, 1.414, 1.414, 1.414, 1.414};
+        INSTR_COUNT(NODES_EXPANDED);
 
         for (int k = 0; k < 8; ++k) {
-            int newX = x + dx[k];
-            int newY = y + dy[k];
+            int newX = x + DX[k];
+            int newY = y + DY[k];
 
             if (isValid(newX, newY, ROW, COL)) {
                 if (isDestination(newX, newY, dest)) {
                     cellDetails[newX][newY].parent_x = x;
                     cellDetails[newX][newY].parent_y = y;
-                    cout << "\nThe destination cell is found\n";
-                    tracePath(cellDetails, dest);
-                    return; 
+                    return true;
                 }
                 else if (!closedList[newX][newY] && isUnblocked(grid, newX, newY)) {
-                    double gNew = cellDetails[x][y].g + cost[k];
+                    double gNew = cellDetails[x][y].g + MOVE_COST[k];
                     double hNew = calculateHValue(newX, newY, dest);
                     double fNew = gNew + hNew;
 
                     if (cellDetails[newX][newY].f > fNew) {
+                        INSTR_COUNT(NODES_GENERATED);
                         openList.push({fNew, newX, newY});
                         cellDetails[newX][newY].f = fNew;
                         cellDetails[newX][newY].g = gNew;
@@ -148,11 +138,777 @@ void aStarSearch(const vector<vector<int>>& grid, const pair<int, int>& src, con
         }
     }
 
+    return false;
+}
+
+
+void aStarSearch(const vector<vector<int>>& grid, const pair<int, int>& src, const pair<int, int>& dest) {
+    int ROW = grid.size();
+    int COL = grid[0].size();
+    
+    
+    if (!isValid(src.first, src.second, ROW, COL) || !isValid(dest.first, dest.second, ROW, COL)) {
+        cout << "Source or Destination is invalid\n";
+        return;
+    }
+
+    
+    if (!isUnblocked(grid, src.first, src.second) || !isUnblocked(grid, dest.first, dest.second)) {
+        cout << "Source or the destination is blocked\n";
+        return;
+    }
+
+    
+    if (isDestination(src.first, src.second, dest)) {
+        cout << "We are already at the destination\n";
+        return;
+    }
+    
+    
+    vector<vector<Cell>> cellDetails(ROW, vector<Cell>(COL));
+
+    if (aStarCore(grid, src, dest, cellDetails)) {
+        cout << "\nThe destination cell is found\n";
+        tracePath(cellDetails, dest);
+        return;
+    }
+
     cout << "Failed to find the Destination Cell\n";
 }
 
 
-int main() {
+// Octile distance: the exact cost on an open map with MOVE_COST, so it never
+// overestimates. calculateHValue (Manhattan) can, once diagonal moves are allowed,
+// and the bound reported by anytimeAStarCore needs a heuristic that does not.
+double octileDistance(int row, int col, const pair<int, int>& dest) {
+    double dx = abs(row - dest.first), dy = abs(col - dest.second);
+    return max(dx, dy) + (MOVE_COST[4] - MOVE_COST[0]) * min(dx, dy);
+}
+
+
+struct AnytimeResult {
+    bool found = false;
+    double cost = numeric_limits<double>::max();    // cost of the path left in cellDetails
+    double bound = numeric_limits<double>::max();   // cost <= bound * optimal cost
+    int searches = 0;                               // weighted searches completed
+    bool timedOut = false;                          // stopped by the budget
+    double firstMs = 0;                             // time to the first path with a bound
+};
+
+
+// Anytime repairing A* (ARA*). The first search inflates the heuristic by epsilon,
+// which finds a path quickly but only within a factor epsilon of optimal. Then
+// epsilon is lowered by step and the search resumes from where it stopped: cells
+// whose cost improved after they were expanded are kept aside and reopened, instead
+// of starting over. Each finished search tightens the bound to the path cost over
+// the smallest g + h left open. Stops at budgetMs or once the path is optimal.
+// Fills cellDetails like aStarCore (parents trace back to src, which is its own
+// parent), so tracePath prints the best path found. Assumes src and dest are valid,
+// unblocked and distinct.
+AnytimeResult anytimeAStarCore(const vector<vector<int>>& grid, const pair<int, int>& src,
+                               const pair<int, int>& dest, vector<vector<Cell>>& cellDetails, double budgetMs,
+                               double epsilon = 3.0, double step = 0.5) {
+    enum : char { NEW, OPEN, CLOSED, INCONS };
+    auto start = chrono::steady_clock::now();
+    auto deadline = start + chrono::duration_cast<chrono::steady_clock::duration>(
+                                chrono::duration<double, milli>(min(budgetMs, 1e12)));
+    int ROW = grid.size();
+    int COL = grid[0].size();
+    const double INF = numeric_limits<double>::max();
+
+    vector<vector<char>> state(ROW, vector<char>(COL, NEW));
+    vector<pair<int, int>> closed, incons;
+    // A plain vector kept as a heap, so the open list can be scanned and re-keyed in
+    // place between searches.
+    vector<tuple<double, int, int>> openList;
+    auto later = greater<tuple<double, int, int>>();
+    auto key = [&](int x, int y) { return cellDetails[x][y].g + epsilon * cellDetails[x][y].h; };
+    auto open = [&](int x, int y) {
+        state[x][y] = OPEN;
+        cellDetails[x][y].f = key(x, y);
+        openList.push_back({cellDetails[x][y].f, x, y});
+        push_heap(openList.begin(), openList.end(), later);
+    };
+
+    Cell& goal = cellDetails[dest.first][dest.second];
+    goal.h = 0.0;
+    Cell& first = cellDetails[src.first][src.second];
+    first.g = 0.0;
+    first.h = octileDistance(src.first, src.second, dest);
+    first.parent_x = src.first;
+    first.parent_y = src.second;
+    open(src.first, src.second);
+
+    AnytimeResult result;
+    for (long steps = 0;;) {
+        // Expand until nothing open could improve the path to dest at this epsilon.
+        bool expired = false;
+        while (!openList.empty()) {
+            auto [f, x, y] = openList.front();
+            if (state[x][y] != OPEN || f != key(x, y)) {    // superseded entry
+                pop_heap(openList.begin(), openList.end(), later);
+                openList.pop_back();
+                INSTR_COUNT(PRUNED);
+                continue;
+            }
+            if (goal.g <= f) break;
+            if ((++steps & 255) == 0 && chrono::steady_clock::now() > deadline) {
+                expired = true;
+                break;
+            }
+            pop_heap(openList.begin(), openList.end(), later);
+            openList.pop_back();
+            state[x][y] = CLOSED;
+            closed.push_back({x, y});
+            INSTR_COUNT(NODES_EXPANDED);
+
+            for (int k = 0; k < 8; ++k) {
+                int newX = x + DX[k];
+                int newY = y + DY[k];
+                if (!isValid(newX, newY, ROW, COL) || !isUnblocked(grid, newX, newY)) continue;
+                Cell& next = cellDetails[newX][newY];
+                double gNew = cellDetails[x][y].g + MOVE_COST[k];
+                if (gNew >= next.g) continue;
+                if (next.h == INF) next.h = octileDistance(newX, newY, dest);
+                next.g = gNew;
+                next.parent_x = x;
+                next.parent_y = y;
+                INSTR_COUNT(NODES_GENERATED);
+                if (state[newX][newY] == CLOSED) {
+                    state[newX][newY] = INCONS;
+                    incons.push_back({newX, newY});
+                } else if (state[newX][newY] != INCONS) {
+                    open(newX, newY);
+                }
+            }
+        }
+
+        if (expired) {
+            result.timedOut = true;
+            // A path found by an unfinished first search comes with no bound.
+            if (!result.found && goal.g < INF) {
+                result.found = true;
+                result.cost = goal.g;
+            }
+            return result;
+        }
+        if (goal.g == INF) return result;   // everything reachable was expanded
+
+        // Whatever is still open or set aside bounds the optimal cost from below.
+        size_t live = 0;
+        for (auto& entry : openList) {
+            auto [f, x, y] = entry;
+            if (state[x][y] == OPEN && f == key(x, y)) openList[live++] = entry;
+        }
+        openList.resize(live);
+        double lowest = INF;
+        for (auto& [f, x, y] : openList) lowest = min(lowest, cellDetails[x][y].g + cellDetails[x][y].h);
+        for (auto [x, y] : incons) lowest = min(lowest, cellDetails[x][y].g + cellDetails[x][y].h);
+
+        if (!result.found) result.firstMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        result.found = true;
+        result.cost = goal.g;
+        result.bound = max(1.0, min(epsilon, lowest == INF ? 1.0 : goal.g / lowest));
+        ++result.searches;
+        if (result.bound <= 1.0 || chrono::steady_clock::now() > deadline) return result;
+
+        // Next search: smaller epsilon, expanded cells may be expanded again.
+        epsilon = max(1.0, epsilon - step);
+        for (auto [x, y] : closed) state[x][y] = NEW;
+        closed.clear();
+        for (auto& [f, x, y] : openList) f = cellDetails[x][y].f = key(x, y);
+        for (auto [x, y] : incons) {
+            state[x][y] = OPEN;
+            cellDetails[x][y].f = key(x, y);
+            openList.push_back({cellDetails[x][y].f, x, y});
+        }
+        incons.clear();
+        make_heap(openList.begin(), openList.end(), later);
+    }
+}
+
+
+// aStarSearch with a time limit: prints the best path found within budgetMs and how
+// far from optimal it can be.
+void anytimeAStarSearch(const vector<vector<int>>& grid, const pair<int, int>& src, const pair<int, int>& dest,
+                        double budgetMs) {
+    int ROW = grid.size();
+    int COL = grid[0].size();
+
+    if (!isValid(src.first, src.second, ROW, COL) || !isValid(dest.first, dest.second, ROW, COL)) {
+        cout << "Source or Destination is invalid\n";
+        return;
+    }
+
+    if (!isUnblocked(grid, src.first, src.second) || !isUnblocked(grid, dest.first, dest.second)) {
+        cout << "Source or the destination is blocked\n";
+        return;
+    }
+
+    if (isDestination(src.first, src.second, dest)) {
+        cout << "We are already at the destination\n";
+        return;
+    }
+
+    vector<vector<Cell>> cellDetails(ROW, vector<Cell>(COL));
+    AnytimeResult result = anytimeAStarCore(grid, src, dest, cellDetails, budgetMs);
+    if (result.found) {
+        cout << "\nThe destination cell is found\n";
+        cout << "Path cost " << result.cost;
+        if (result.bound == numeric_limits<double>::max())
+            cout << ", no bound proven within " << budgetMs << " ms\n";
+        else if (result.bound <= 1.0)
+            cout << ", optimal (weighted searches: " << result.searches << ")\n";
+        else
+            cout << ", at most " << result.bound << " times optimal (weighted searches: " << result.searches << ")\n";
+        tracePath(cellDetails, dest);
+        return;
+    }
+
+    if (result.timedOut)
+        cout << "No path found within " << budgetMs << " ms\n";
+    else
+        cout << "Failed to find the Destination Cell\n";
+}
+
+
+// Scratch space owned by one worker thread and reused for every source it runs,
+// so a table of N sources does N searches but only one allocation per thread.
+struct DijkstraBuffers {
+    vector<double> dist;
+    vector<unsigned> stamp;   // dist[v] is only meaningful when stamp[v] == generation
+    vector<char> settled;
+    vector<pair<double, int>> heap;
+    unsigned generation = 0;
+
+    explicit DijkstraBuffers(int cells) : dist(cells), stamp(cells, 0), settled(cells, 0) {}
+};
+
+
+// One Dijkstra from src that stops as soon as every target cell has been settled.
+// Writes the cost to each point of interest into row (max() when unreachable).
+void multiTargetDijkstra(const vector<char>& walkable, int ROW, int COL,
+                         const vector<int>& pointCell, const vector<char>& isTarget, int targetCount,
+                         int src, DijkstraBuffers& buf, vector<double>& row) {
+    const double INF = numeric_limits<double>::max();
+    unsigned gen = ++buf.generation;
+    buf.heap.clear();
+
+    auto greaterFirst = [](const pair<double, int>& a, const pair<double, int>& b) { return a.first > b.first; };
+
+    // Only cells reached in this generation can be settled, so settled[] is reset lazily too.
+    auto touch = [&](int v, double d) {
+        if (buf.stamp[v] != gen) {
+            buf.stamp[v] = gen;
+            buf.settled[v] = 0;
+            buf.dist[v] = INF;
+        }
+        if (d < buf.dist[v]) {
+            INSTR_COUNT(NODES_GENERATED);
+            buf.dist[v] = d;
+            buf.heap.push_back({d, v});
+            push_heap(buf.heap.begin(), buf.heap.end(), greaterFirst);
+        }
+    };
+
+    int remaining = targetCount;
+    if (walkable[src]) touch(src, 0.0);
+
+    while (!buf.heap.empty() && remaining > 0) {
+        pop_heap(buf.heap.begin(), buf.heap.end(), greaterFirst);
+        auto [d, v] = buf.heap.back();
+        buf.heap.pop_back();
+        if (buf.settled[v] || d > buf.dist[v]) {
+            INSTR_COUNT(PRUNED);
+            continue;
+        }
+        buf.settled[v] = 1;
+        INSTR_COUNT(NODES_EXPANDED);
+        if (isTarget[v]) --remaining;
+
+        int x = v / COL, y = v % COL;
+        for (int k = 0; k < 8; ++k) {
+            int newX = x + DX[k];
+            int newY = y + DY[k];
+            if (!isValid(newX, newY, ROW, COL)) continue;
+            int w = newX * COL + newY;
+            if (walkable[w]) touch(w, d + MOVE_COST[k]);
+        }
+    }
+
+    for (size_t p = 0; p < pointCell.size(); ++p) {
+        int c = pointCell[p];
+        row[p] = (buf.stamp[c] == gen && buf.settled[c]) ? buf.dist[c] : INF;
+    }
+}
+
+
+// Dense many-to-many cost matrix: table[a][b] is the cheapest 8-connected path cost
+// from points[a] to points[b], or max() when b is unreachable or either end is blocked.
+// Each source needs one search instead of N, and sources are shared out across threads.
+vector<vector<double>> distanceTable(const vector<vector<int>>& grid, const vector<pair<int, int>>& points,
+                                     int numThreads = 0) {
+    int ROW = grid.size();
+    int COL = grid[0].size();
+    int n = points.size();
+    vector<vector<double>> table(n, vector<double>(n, numeric_limits<double>::max()));
+    if (n == 0) return table;
+
+    vector<char> walkable(ROW * COL);
+    for (int r = 0; r < ROW; ++r)
+        for (int c = 0; c < COL; ++c)
+            walkable[r * COL + c] = isUnblocked(grid, r, c);
+
+    vector<int> pointCell(n);
+    vector<char> isTarget(ROW * COL, 0);
+    int targetCount = 0;
+    for (int p = 0; p < n; ++p) {
+        if (!isValid(points[p].first, points[p].second, ROW, COL)) {
+            pointCell[p] = -1;
+            continue;
+        }
+        int c = points[p].first * COL + points[p].second;
+        pointCell[p] = c;
+        if (walkable[c] && !isTarget[c]) {
+            isTarget[c] = 1;
+            ++targetCount;
+        }
+    }
+
+    // Invalid points get a dummy cell that is never settled, so their column stays max().
+    vector<int> safeCell = pointCell;
+    for (int& c : safeCell) if (c < 0) c = 0;
+
+    if (numThreads <= 0) numThreads = max(1u, thread::hardware_concurrency());
+    numThreads = min(numThreads, n);
+
+    atomic<int> nextSource(0);
+    auto worker = [&]() {
+        DijkstraBuffers buf(ROW * COL);
+        vector<double> row(n);
+        int s;
+        while ((s = nextSource.fetch_add(1)) < n) {
+            if (pointCell[s] < 0 || !walkable[pointCell[s]]) continue;
+            multiTargetDijkstra(walkable, ROW, COL, safeCell, isTarget, targetCount, pointCell[s], buf, row);
+            for (int p = 0; p < n; ++p)
+                table[s][p] = pointCell[p] < 0 ? numeric_limits<double>::max() : row[p];
+        }
+    };
+
+    vector<thread> pool;
+    for (int t = 1; t < numThreads; ++t) pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool) t.join();
+
+    return table;
+}
+
+
+// Cost or number of moves from every cell to one goal, for many agents heading to
+// the same place: the field is built once, and after that each agent's next step
+// is a lookup instead of a search. Moves are the 8-connected DX/DY moves, which
+// are symmetric, so distances from the goal are distances to it.
+class DistanceField {
+public:
+    explicit DistanceField(const vector<vector<int>>& grid)
+        : ROW(grid.size()), COL(grid[0].size()), WORDS((COL + 63) / 64), open(ROW * WORDS, 0) {
+        for (int r = 0; r < ROW; ++r)
+            for (int c = 0; c < COL; ++c)
+                if (isUnblocked(grid, r, c)) open[r * WORDS + c / 64] |= 1ULL << (c % 64);
+    }
+
+    // Fewest moves to goal, every move counting 1. The grid is packed 64 cells per
+    // word, so the wavefront grows a whole layer at a time with word operations:
+    // OR the frontier rows above and below into each row, smear one bit left and
+    // right (carrying across words), and keep the open cells not reached yet. The
+    // word loops have no dependencies between words, so the compiler vectorizes them.
+    void buildHops(const pair<int, int>& goal) {
+        hopsTo.assign(ROW * COL, -1);
+        if (!walkable(goal.first, goal.second)) return;
+        vector<uint64_t> reached(ROW * WORDS, 0), frontier(ROW * WORDS, 0), next(ROW * WORDS, 0), column(WORDS);
+        int g = goal.first * WORDS + goal.second / 64;
+        frontier[g] = reached[g] = 1ULL << (goal.second % 64);
+        hopsTo[goal.first * COL + goal.second] = 0;
+        int lo = goal.first, hi = goal.first;    // rows the frontier is in
+
+        for (int layer = 1; lo <= hi; ++layer) {
+            int newLo = ROW, newHi = -1;
+            for (int r = max(0, lo - 1); r <= min(ROW - 1, hi + 1); ++r) {
+                const uint64_t* above = r > 0 ? &frontier[(r - 1) * WORDS] : nullptr;
+                const uint64_t* same = &frontier[r * WORDS];
+                const uint64_t* below = r + 1 < ROW ? &frontier[(r + 1) * WORDS] : nullptr;
+                for (int w = 0; w < WORDS; ++w)
+                    column[w] = same[w] | (above ? above[w] : 0) | (below ? below[w] : 0);
+
+                uint64_t* out = &next[r * WORDS];
+                const uint64_t* openRow = &open[r * WORDS];
+                uint64_t* seen = &reached[r * WORDS];
+                uint64_t any = 0;
+                for (int w = 0; w < WORDS; ++w) {
+                    uint64_t spread = column[w] | column[w] << 1 | column[w] >> 1;
+                    if (w > 0) spread |= column[w - 1] >> 63;
+                    if (w + 1 < WORDS) spread |= column[w + 1] << 63;
+                    out[w] = spread & openRow[w] & ~seen[w];
+                    seen[w] |= out[w];
+                    any |= out[w];
+                }
+                if (!any) continue;
+                newLo = min(newLo, r);
+                newHi = max(newHi, r);
+                for (int w = 0; w < WORDS; ++w)
+                    for (uint64_t bits = out[w]; bits; bits &= bits - 1)
+                        hopsTo[r * COL + w * 64 + __builtin_ctzll(bits)] = layer;
+                INSTR_COUNT(NODES_EXPANDED);
+            }
+            // Clear the old frontier so the buffer is all zero when it is written next.
+            fill(frontier.begin() + lo * WORDS, frontier.begin() + (hi + 1) * WORDS, 0);
+            swap(frontier, next);
+            lo = newLo;
+            hi = newHi;
+        }
+    }
+
+    // Cheapest cost to goal with MOVE_COST. There are only two edge costs, so this is
+    // Dijkstra with two FIFO queues instead of a heap: cells leave each queue in the
+    // order they were settled, plus a constant, so each queue stays sorted and the
+    // smaller of the two heads is always the next cell to settle.
+    void buildCosts(const pair<int, int>& goal) {
+        const double INF = numeric_limits<double>::max();
+        costTo.assign(ROW * COL, INF);
+        toward.assign(ROW * COL, -1);
+        if (!walkable(goal.first, goal.second)) return;
+        vector<char> settled(ROW * COL, 0);
+        vector<pair<double, int>> straight, diagonal;
+        size_t s = 0, d = 0;
+        int start = goal.first * COL + goal.second;
+        costTo[start] = 0.0;
+        toward[start] = start;
+        straight.push_back({0.0, start});
+
+        while (s < straight.size() || d < diagonal.size()) {
+            bool takeStraight = d == diagonal.size() || (s < straight.size() && straight[s].first <= diagonal[d].first);
+            auto [dist, v] = takeStraight ? straight[s++] : diagonal[d++];
+            if (settled[v] || dist > costTo[v]) {
+                INSTR_COUNT(PRUNED);
+                continue;
+            }
+            settled[v] = 1;
+            INSTR_COUNT(NODES_EXPANDED);
+            int x = v / COL, y = v % COL;
+            for (int k = 0; k < 8; ++k) {
+                int newX = x + DX[k];
+                int newY = y + DY[k];
+                if (!isValid(newX, newY, ROW, COL) || !walkable(newX, newY)) continue;
+                int w = newX * COL + newY;
+                double next = dist + MOVE_COST[k];
+                if (next >= costTo[w]) continue;
+                INSTR_COUNT(NODES_GENERATED);
+                costTo[w] = next;
+                toward[w] = v;
+                (k < 4 ? straight : diagonal).push_back({next, w});
+            }
+        }
+    }
+
+    // -1 where the goal cannot be reached. Needs buildHops.
+    int hops(int row, int col) const { return hopsTo[row * COL + col]; }
+
+    // max() where the goal cannot be reached. Needs buildCosts.
+    double cost(int row, int col) const { return costTo[row * COL + col]; }
+
+    // The neighbour to move to on a cheapest path to the goal; the cell itself at the
+    // goal, and (-1, -1) where the goal cannot be reached. Needs buildCosts.
+    pair<int, int> nextStepByCost(int row, int col) const {
+        int v = toward[row * COL + col];
+        return v < 0 ? make_pair(-1, -1) : make_pair(v / COL, v % COL);
+    }
+
+    // Same for the fewest moves: a neighbour one layer closer. Needs buildHops.
+    pair<int, int> nextStepByHops(int row, int col) const {
+        int h = hops(row, col);
+        if (h <= 0) return h == 0 ? make_pair(row, col) : make_pair(-1, -1);
+        for (int k = 0; k < 8; ++k) {
+            int newX = row + DX[k];
+            int newY = col + DY[k];
+            if (isValid(newX, newY, ROW, COL) && hops(newX, newY) == h - 1) return {newX, newY};
+        }
+        return {-1, -1};
+    }
+
+private:
+    int ROW, COL, WORDS;
+    vector<uint64_t> open;      // bit c % 64 of word r * WORDS + c / 64: cell (r, c) is walkable
+    vector<int> hopsTo;
+    vector<double> costTo;
+    vector<int> toward;         // next cell on a cheapest path, as row * COL + col
+
+    bool walkable(int row, int col) const { return open[row * WORDS + col / 64] >> (col % 64) & 1; }
+};
+
+
+// Times distanceTable against one aStarCore call per ordered pair on a random map.
+void distanceTableBenchmark(int rows, int cols, int numPoints) {
+    mt19937 rng(42);
+    vector<vector<int>> grid(rows, vector<int>(cols));
+    for (auto& r : grid)
+        for (int& c : r) c = (rng() % 100) < 75 ? 1 : 0;
+
+    vector<pair<int, int>> points;
+    while ((int)points.size() < numPoints) {
+        int r = rng() % rows, c = rng() % cols;
+        if (grid[r][c] == 1) points.push_back({r, c});
+    }
+
+    auto t0 = chrono::high_resolution_clock::now();
+    int found = 0;
+    for (int a = 0; a < numPoints; ++a)
+        for (int b = 0; b < numPoints; ++b) {
+            if (points[a] == points[b]) continue;
+            vector<vector<Cell>> cellDetails(rows, vector<Cell>(cols));
+            found += aStarCore(grid, points[a], points[b], cellDetails);
+        }
+    auto t1 = chrono::high_resolution_clock::now();
+    vector<vector<double>> table = distanceTable(grid, points);
+    auto t2 = chrono::high_resolution_clock::now();
+
+    int reachable = 0;
+    for (int a = 0; a < numPoints; ++a)
+        for (int b = 0; b < numPoints; ++b)
+            if (a != b && table[a][b] < numeric_limits<double>::max()) ++reachable;
+
+    double pairMs = chrono::duration<double, milli>(t1 - t0).count();
+    double tableMs = chrono::duration<double, milli>(t2 - t1).count();
+    cout << "Grid " << rows << "x" << cols << ", " << numPoints << " points, "
+         << thread::hardware_concurrency() << " hardware threads\n";
+    cout << "Pairwise A*    : " << pairMs << " ms (" << found << " pairs reached)\n";
+    cout << "Distance table : " << tableMs << " ms (" << reachable << " pairs reached)\n";
+    cout << "Speedup        : " << pairMs / tableMs << "x\n";
+}
+
+
+// Many agents, one goal, on a random map: one aStarCore per agent against building
+// the distance fields once and following them. Checks both fields, cell by cell,
+// against a heap Dijkstra and a queue BFS.
+void distanceFieldBenchmark(int size, int numAgents) {
+    mt19937 rng(42);
+    vector<vector<int>> grid(size, vector<int>(size));
+    for (auto& r : grid)
+        for (int& c : r) c = (rng() % 100) < 75 ? 1 : 0;
+    vector<pair<int, int>> points;     // the goal, then the agents
+    while ((int)points.size() < numAgents + 1) {
+        int r = rng() % size, c = rng() % size;
+        if (grid[r][c] == 1) points.push_back({r, c});
+    }
+    pair<int, int> goal = points[0];
+    auto since = [](chrono::steady_clock::time_point t) {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - t).count();
+    };
+
+    auto t0 = chrono::steady_clock::now();
+    int found = 0;
+    for (int a = 1; a <= numAgents; ++a) {
+        if (points[a] == goal) continue;
+        vector<vector<Cell>> cellDetails(size, vector<Cell>(size));
+        found += aStarCore(grid, points[a], goal, cellDetails);
+    }
+    double searchMs = since(t0);
+
+    DistanceField field(grid);
+    auto t1 = chrono::steady_clock::now();
+    field.buildCosts(goal);
+    double costMs = since(t1);
+    auto t2 = chrono::steady_clock::now();
+    field.buildHops(goal);
+    double hopMs = since(t2);
+
+    // Every agent walks to the goal one lookup at a time.
+    auto t3 = chrono::steady_clock::now();
+    long long steps = 0;
+    int arrived = 0, wrongWalks = 0;
+    for (int a = 1; a <= numAgents; ++a) {
+        pair<int, int> at = points[a];
+        double walked = 0;
+        while (at != goal && at.first >= 0) {
+            pair<int, int> next = field.nextStepByCost(at.first, at.second);
+            bool diagonal = next.first != at.first && next.second != at.second;
+            walked += diagonal ? MOVE_COST[4] : MOVE_COST[0];
+            at = next;
+            ++steps;
+        }
+        if (at != goal) continue;
+        ++arrived;
+        if (abs(walked - field.cost(points[a].first, points[a].second)) > 1e-6) ++wrongWalks;
+    }
+    double walkMs = since(t3);
+
+    // Reference values from a heap Dijkstra and a queue BFS over the whole grid.
+    const double INF = numeric_limits<double>::max();
+    vector<double> dist(size * size, INF);
+    vector<int> layer(size * size, -1), bfs{goal.first * size + goal.second};
+    priority_queue<pair<double, int>, vector<pair<double, int>>, greater<pair<double, int>>> heap;
+    dist[bfs[0]] = 0.0;
+    layer[bfs[0]] = 0;
+    heap.push({0.0, bfs[0]});
+    while (!heap.empty()) {
+        auto [d, v] = heap.top();
+        heap.pop();
+        if (d > dist[v]) continue;
+        for (int k = 0; k < 8; ++k) {
+            int newX = v / size + DX[k], newY = v % size + DY[k];
+            if (!isValid(newX, newY, size, size) || !grid[newX][newY]) continue;
+            int w = newX * size + newY;
+            if (d + MOVE_COST[k] < dist[w]) {
+                dist[w] = d + MOVE_COST[k];
+                heap.push({dist[w], w});
+            }
+        }
+    }
+    for (size_t head = 0; head < bfs.size(); ++head)
+        for (int k = 0; k < 8; ++k) {
+            int newX = bfs[head] / size + DX[k], newY = bfs[head] % size + DY[k];
+            if (!isValid(newX, newY, size, size) || !grid[newX][newY] || layer[newX * size + newY] >= 0) continue;
+            layer[newX * size + newY] = layer[bfs[head]] + 1;
+            bfs.push_back(newX * size + newY);
+        }
+    int wrongCosts = 0, wrongHops = 0;
+    for (int r = 0; r < size; ++r)
+        for (int c = 0; c < size; ++c) {
+            double got = field.cost(r, c), expected = dist[r * size + c];
+            wrongCosts += expected == INF ? got != INF : abs(got - expected) > 1e-6;
+            wrongHops += field.hops(r, c) != layer[r * size + c];
+        }
+
+    cout << "Grid " << size << "x" << size << ", " << numAgents << " agents, one goal\n";
+    cout << "aStarCore per agent : " << searchMs << " ms (" << found << " reached)\n";
+    cout << "Cost field (2 queue): " << costMs << " ms\n";
+    cout << "Hop field (bitwise) : " << hopMs << " ms\n";
+    cout << "Following the field : " << walkMs << " ms for " << steps << " steps, " << arrived << " agents arrived\n";
+    cout << "Mismatches: " << wrongCosts << " costs, " << wrongWalks << " walks, " << wrongHops << " hop counts\n";
+}
+
+
+// Latency of random queries on a large map: aStarCore, ARA* run until optimal, and
+// ARA* with a budget of budgetMs. For the budgeted runs, also compares the path cost
+// with the optimal one and checks it against the reported bound.
+void anytimeBenchmark(int size, double budgetMs, int queries) {
+    mt19937 rng(7);
+    vector<vector<int>> grid(size, vector<int>(size));
+    for (auto& r : grid)
+        for (int& c : r) c = (rng() % 100) < 75 ? 1 : 0;
+
+    vector<double> plainMs, optimalMs, budgetedMs;
+    double ratioSum = 0, worstRatio = 1, boundSum = 0;
+    int solved = 0, bounded = 0, broken = 0;
+    auto since = [](chrono::steady_clock::time_point t) {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - t).count();
+    };
+    for (int q = 0; q < queries; ++q) {
+        pair<int, int> src, dest;
+        do {
+            src = {rng() % size, rng() % size};
+            dest = {rng() % size, rng() % size};
+        } while (!grid[src.first][src.second] || !grid[dest.first][dest.second] || src == dest);
+
+        // Search time only: the Cell grids are allocated up front.
+        vector<vector<Cell>> plain(size, vector<Cell>(size)), exact = plain, cells = plain;
+        auto t0 = chrono::steady_clock::now();
+        aStarCore(grid, src, dest, plain);
+        plainMs.push_back(since(t0));
+
+        auto t1 = chrono::steady_clock::now();
+        AnytimeResult optimal = anytimeAStarCore(grid, src, dest, exact, numeric_limits<double>::infinity(), 1.0);
+        optimalMs.push_back(since(t1));
+
+        auto t2 = chrono::steady_clock::now();
+        AnytimeResult quick = anytimeAStarCore(grid, src, dest, cells, budgetMs);
+        budgetedMs.push_back(since(t2));
+
+        if (!optimal.found || !quick.found) continue;
+        ++solved;
+        double ratio = quick.cost / optimal.cost;
+        ratioSum += ratio;
+        worstRatio = max(worstRatio, ratio);
+        if (quick.bound != numeric_limits<double>::max()) {
+            ++bounded;
+            boundSum += quick.bound;
+            if (ratio > quick.bound + 1e-9) ++broken;
+        }
+    }
+
+    auto report = [](const string& name, vector<double> ms) {
+        sort(ms.begin(), ms.end());
+        auto at = [&](double p) { return ms[min(ms.size() - 1, (size_t)(p * ms.size()))]; };
+        cout << name << ": p50 " << at(0.5) << " ms, p99 " << at(0.99) << " ms, max " << ms.back() << " ms\n";
+    };
+    cout << "Grid " << size << "x" << size << ", " << queries << " random queries, budget " << budgetMs << " ms\n";
+    report("A* (aStarCore)      ", plainMs);
+    report("ARA* until optimal  ", optimalMs);
+    report("ARA* with the budget", budgetedMs);
+    cout << "Budgeted paths: " << solved << " found, cost / optimal " << (solved ? ratioSum / solved : 0)
+         << " on average, " << worstRatio << " at worst\n";
+    cout << "Bound proven for " << bounded << ", " << (bounded ? boundSum / bounded : 0) << " on average, "
+         << broken << " exceeded\n";
+}
+
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && string(argv[1]) == "--field") {
+        distanceFieldBenchmark(argc > 2 ? atoi(argv[2]) : 1000, argc > 3 ? atoi(argv[3]) : 200);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--anytime") {
+        anytimeBenchmark(argc > 2 ? atoi(argv[2]) : 1000, argc > 3 ? atof(argv[3]) : 10.0,
+                         argc > 4 ? atoi(argv[4]) : 50);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        distanceTableBenchmark(200, 200, 128);
+        return 0;
+    }
+    // One JSON line per search (schema in instrumentation.h); build with
+    // -DINSTRUMENTATION=1 for the work counters.
+    if (argc > 1 && string(argv[1]) == "--json") {
+        // One corner-to-corner search and one distance table on a random 200x200 map,
+        // reported in the schema of instrumentation.h.
+        mt19937 rng(42);
+        vector<vector<int>> grid(200, vector<int>(200));
+        for (auto& r : grid)
+            for (int& c : r) c = (rng() % 100) < 75 ? 1 : 0;
+        grid[0][0] = grid[199][199] = 1;
+        vector<vector<Cell>> cellDetails(200, vector<Cell>(200));
+        instr::Run single("a* search", "200x200 random, corner to corner");
+        bool found = aStarCore(grid, {0, 0}, {199, 199}, cellDetails);
+        single.extra("found", found);
+        cout << single.finish() << "\n";
+
+        vector<vector<Cell>> anytimeCells(200, vector<Cell>(200));
+        instr::Run anytime("ara*", "200x200 random, corner to corner, 5 ms");
+        AnytimeResult result = anytimeAStarCore(grid, {0, 0}, {199, 199}, anytimeCells, 5.0);
+        anytime.extra("found", result.found).extra("cost", result.cost).extra("bound", result.bound)
+               .extra("searches", result.searches);
+        cout << anytime.finish() << "\n";
+
+        vector<pair<int, int>> points;
+        while (points.size() < 64) {
+            int r = rng() % 200, c = rng() % 200;
+            if (grid[r][c] == 1) points.push_back({r, c});
+        }
+        instr::Run table("dijkstra distance table", "200x200 random, 64 points");
+        distanceTable(grid, points);
+        cout << table.finish() << "\n";
+
+        DistanceField field(grid);
+        instr::Run costs("two-queue cost field", "200x200 random, goal at a corner");
+        field.buildCosts({199, 199});
+        costs.extra("cost", field.cost(0, 0));
+        cout << costs.finish() << "\n";
+        instr::Run hops("bitwise hop field", "200x200 random, goal at a corner");
+        field.buildHops({199, 199});
+        hops.extra("hops", field.hops(0, 0));
+        cout << hops.finish() << "\n";
+        return 0;
+    }
+
     int rows, cols;
     cout << "Enter the number of rows: ";
     cin >> rows;
@@ -177,7 +933,11 @@ int main() {
     cout << "Enter the destination coordinates (row col): ";
     cin >> dest.first >> dest.second;
 
-    aStarSearch(grid, src, dest);
+    // "--budget 5" answers within 5 ms with the best path found so far.
+    if (argc > 2 && string(argv[1]) == "--budget")
+        anytimeAStarSearch(grid, src, dest, atof(argv[2]));
+    else
+        aStarSearch(grid, src, dest);
 
     return 0;
 }
\ No newline at end of file
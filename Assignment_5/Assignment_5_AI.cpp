@@ -1,7 +1,9 @@
 // tic_tac_toe_minimax.cpp
-// Compile: g++ -std=c++17 -O2 -o ttt tic_tac_toe_minimax.cpp
+// Compile: g++ -std=c++17 -O2 -pthread -o ttt tic_tac_toe_minimax.cpp
+// Add -DINSTRUMENTATION=1 for the work counters of "--json".
 
 #include <bits/stdc++.h>
+#include "../common/instrumentation.h"
 using namespace std;
 
 const char AI = 'X';
@@ -58,17 +60,19 @@ int minimax(vector<char>& board, int depth, bool isMaximizing, int alpha, int be
     if (winner != 0 || !isMovesLeft(board)) {
         return evaluate(board, depth);
     }
+    INSTR_COUNT(NODES_EXPANDED);
 
     if (isMaximizing) {
         int best = INT_MIN;
         for (int i = 0; i < 9; ++i) {
             if (board[i] == EMPTY) {
                 board[i] = AI;
+                INSTR_COUNT(NODES_GENERATED);
                 int val = minimax(board, depth + 1, false, alpha, beta);
                 board[i] = EMPTY;
                 best = max(best, val);
                 alpha = max(alpha, best);
-                if (beta <= alpha) break; // beta cut-off
+                if (beta <= alpha) { INSTR_COUNT(PRUNED); break; } // beta cut-off
             }
         }
         return best;
@@ -77,18 +81,20 @@ int minimax(vector<char>& board, int depth, bool isMaximizing, int alpha, int be
         for (int i = 0; i < 9; ++i) {
             if (board[i] == EMPTY) {
                 board[i] = HUMAN;
+                INSTR_COUNT(NODES_GENERATED);
                 int val = minimax(board, depth + 1, true, alpha, beta);
                 board[i] = EMPTY;
                 best = min(best, val);
                 beta = min(beta, best);
-                if (beta <= alpha) break; // alpha cut-off
+                if (beta <= alpha) { INSTR_COUNT(PRUNED); break; } // alpha cut-off
             }
         }
         return best;
     }
 }
 
-int findBestMove(vector<char>& board) {
+// Plain minimax over every root move. Kept as the reference the faster engines are checked against.
+int findBestMoveMinimax(vector<char>& board) {
     int bestVal = INT_MIN;
     int bestMove = -1;
     for (int i = 0; i < 9; ++i) {
@@ -105,10 +111,1184 @@ int findBestMove(vector<char>& board) {
     return bestMove;
 }
 
-int main() {
+// ---------------------------------------------------------------------------
+// Bitboard engine
+// ---------------------------------------------------------------------------
+// Each side is one bitmask over the cells (3x3 only uses the low 9 bits), a win is
+// a mask test against precomputed line masks, and positions are cached in a
+// transposition table keyed on the canonical image under the board symmetries.
+// On boards too big to solve, thinkTimed runs iterative deepening against a deadline
+// and scores the leaves by their open lines.
+
+const int MAX_CELLS = 256;
+using Mask = bitset<MAX_CELLS>;
+
+const int WIN_SCORE = 1000000;                    // win in p plies scores WIN_SCORE - p
+const int WIN_BOUND = WIN_SCORE - MAX_CELLS;    // anything above this is a forced result
+
+// Every line of k cells on an m x n board, plus the lines through each cell and
+// where each cell goes under each symmetry of the board.
+struct Geometry {
+    int rows, cols, k, cells;
+    vector<Mask> lines;
+    vector<vector<int>> linesThrough;
+    int symCount;                       // 8 for square boards, 4 otherwise
+    vector<array<int, 8>> sym;          // sym[c][s] = image of cell c under symmetry s
+    Mask full;
+
+    Geometry(int m, int n, int k) : rows(m), cols(n), k(k), cells(m * n), linesThrough(m * n), sym(m * n) {
+        const int dr[] = {0, 1, 1, 1};
+        const int dc[] = {1, 0, 1, -1};
+        for (int r = 0; r < rows; ++r)
+            for (int c = 0; c < cols; ++c)
+                for (int d = 0; d < 4; ++d) {
+                    int er = r + dr[d] * (k - 1), ec = c + dc[d] * (k - 1);
+                    if (er < 0 || er >= rows || ec < 0 || ec >= cols) continue;
+                    Mask line;
+                    for (int i = 0; i < k; ++i) {
+                        int cell = (r + dr[d] * i) * cols + (c + dc[d] * i);
+                        line.set(cell);
+                        linesThrough[cell].push_back(lines.size());
+                    }
+                    lines.push_back(line);
+                }
+
+        symCount = rows == cols ? 8 : 4;
+        for (int r = 0; r < rows; ++r)
+            for (int c = 0; c < cols; ++c) {
+                int fr = rows - 1 - r, fc = cols - 1 - c;
+                array<int, 8>& t = sym[r * cols + c];
+                t[0] = r * cols + c;            // identity
+                t[1] = fr * cols + c;           // vertical flip
+                t[2] = r * cols + fc;           // horizontal flip
+                t[3] = fr * cols + fc;          // 180 degree rotation
+                if (symCount == 8) {            // the four that swap rows and columns
+                    t[4] = c * cols + r;
+                    t[5] = c * cols + fr;
+                    t[6] = fc * cols + r;
+                    t[7] = fc * cols + fr;
+                } else {
+                    t[4] = t[5] = t[6] = t[7] = t[0];
+                }
+                full.set(r * cols + c);
+            }
+    }
+
+    // For each cell, the cells within Chebyshev distance radius of it.
+    vector<Mask> neighbourhood(int radius) const {
+        vector<Mask> around(cells);
+        for (int c = 0; c < cells; ++c) {
+            int r = c / cols, col = c % cols;
+            for (int dr = -radius; dr <= radius; ++dr)
+                for (int dc = -radius; dc <= radius; ++dc) {
+                    int nr = r + dr, nc = col + dc;
+                    if (nr >= 0 && nr < rows && nc >= 0 && nc < cols) around[c].set(nr * cols + nc);
+                }
+        }
+        return around;
+    }
+};
+
+enum BoundType : uint8_t { BOUND_EXACT, BOUND_LOWER, BOUND_UPPER };
+
+struct TTEntry {
+    uint64_t key = 0;
+    int32_t value = 0;
+    int16_t move = -1;      // best move in the canonical orientation
+    int16_t draft = -1;     // plies searched below this node
+    uint8_t bound = BOUND_EXACT;
+};
+
+const int MAX_PLY = MAX_CELLS + 1;
+
+// Shared by every search thread without locks. Each slot stores key ^ data beside the
+// packed data, so a slot torn by two concurrent writers fails the key check on probe
+// instead of handing back fields from two different positions.
+class TranspositionTable {
+public:
+    explicit TranspositionTable(int bits) : slots(new Slot[size_t(1) << bits]), mask((size_t(1) << bits) - 1) {}
+
+    bool probe(uint64_t key, TTEntry& out) const {
+        const Slot& slot = slots[key & mask];
+        uint64_t data = slot.data.load(memory_order_relaxed);
+        if ((slot.check.load(memory_order_relaxed) ^ data) != key || data == 0) return false;
+        out.key = key;
+        out.value = (int32_t)(uint32_t)data;
+        out.move = (int16_t)((data >> 32) & 0xFFFF) - 1;
+        out.draft = (int16_t)((data >> 48) & 0x3FFF) - 1;
+        out.bound = (uint8_t)(data >> 62);
+        return true;
+    }
+
+    void store(const TTEntry& e) {
+        uint64_t data = (uint64_t)(uint32_t)e.value
+                      | (uint64_t)(uint16_t)(e.move + 1) << 32
+                      | (uint64_t)((e.draft + 1) & 0x3FFF) << 48
+                      | (uint64_t)e.bound << 62;
+        Slot& slot = slots[e.key & mask];
+        slot.check.store(e.key ^ data, memory_order_relaxed);
+        slot.data.store(data, memory_order_relaxed);
+    }
+
+private:
+    struct Slot {
+        atomic<uint64_t> check{0};
+        atomic<uint64_t> data{0};
+    };
+    unique_ptr<Slot[]> slots;
+    size_t mask;
+};
+
+class BitEngine {
+public:
+    Geometry geo;
+    long long nodes = 0;
+    int completedDepth = 0;             // deepest fully searched iteration of the last thinkTimed
+    const atomic<bool>* abortFlag = nullptr;    // lets another thread stop this search
+    int helperId = 0;                   // 0 for the main search, >0 for Lazy SMP helpers
+
+    BitEngine(int rows, int cols, int k, int ttBits = 20)
+        : geo(rows, cols, k), tt(make_shared<TranspositionTable>(ttBits)),
+          around(geo.cells), lineWeight(k + 1, 0), lineCount(geo.lines.size()) {
+        mt19937_64 rng(0x9E3779B97F4A7C15ULL);
+        zobrist.resize(2 * geo.cells);
+        for (auto& z : zobrist) z = rng();
+        sideKey = rng();
+        // An open line with c of our marks is worth 8^(c-1); k-1 marks is one move from winning.
+        for (int c = 1; c <= k && c <= 9; ++c) lineWeight[c] = 1LL << (3 * (c - 1));
+        clear();
+    }
+
+    // Only consider empty cells within this Chebyshev distance of a mark (0 = every cell).
+    // Keeps the branching factor sane on Gomoku-sized boards.
+    void setNearRadius(int radius) {
+        nearRadius = radius;
+        around = geo.neighbourhood(radius);
+    }
+
+    void clear() {
+        side[0].reset();
+        side[1].reset();
+        toMove = 0;
+        ply = 0;
+        keys.fill(0);
+        for (auto& lc : lineCount) lc = {0, 0};
+        lineScore = 0;
+        for (auto& k : killers) k[0] = k[1] = -1;
+        for (auto& h : history) h.fill(0);
+    }
+
+    // Loads a char board; stm is the mark whose turn it is. Index 0 always means stm.
+    void setBoard(const vector<char>& board, char stm) {
+        clear();
+        char other = stm == AI ? HUMAN : AI;
+        for (int c = 0; c < geo.cells; ++c) {
+            if (board[c] == stm) place(0, c);
+            else if (board[c] == other) place(1, c);
+        }
+        ply = side[0].count() + side[1].count();
+    }
+
+    // Full-depth alpha-beta from the current position. Returns -1 when no move is left.
+    int bestMove(int* scoreOut = nullptr) {
+        timed = false;
+        stopped = false;
+        int score;
+        int best = rootSearch(geo.cells - ply, -1, score);
+        if (scoreOut) *scoreOut = score;
+        return best;
+    }
+
+    // Iterative deepening until budgetMs runs out or the game is solved. Always returns
+    // the best move of the deepest finished iteration, or a better one found part way
+    // through the iteration that hit the deadline.
+    int thinkTimed(int budgetMs, int* scoreOut = nullptr) {
+        auto start = chrono::steady_clock::now();
+        // Keep a reserve (10%, at least 10 ms, at most half) for unwinding and for
+        // being descheduled on a busy machine between two clock checks.
+        long long reserveUs = min(budgetMs * 500LL, max(budgetMs * 100LL, 10000LL));
+        deadline = start + chrono::microseconds(budgetMs * 1000LL - reserveUs);
+        timed = true;
+        stopped = false;
+        completedDepth = 0;
+
+        int best = -1, bestScore = 0;
+        int remaining = geo.cells - ply;
+        // Helpers start one ply deeper on alternate threads so they spread over the depths.
+        for (int draft = 1 + (helperId & 1); draft <= remaining; ++draft) {
+            int score;
+            int move = rootSearch(draft, best, score);
+            if (move >= 0 && (!stopped || best < 0 || score > bestScore)) {
+                best = move;
+                bestScore = score;
+            }
+            if (stopped) break;
+            completedDepth = draft;
+            if (abs(bestScore) > WIN_BOUND) break;      // forced result, deeper search cannot change it
+            // The next iteration costs several times this one; don't start what cannot finish.
+            if (chrono::steady_clock::now() - start > chrono::milliseconds(budgetMs) / 3) break;
+        }
+        if (scoreOut) *scoreOut = bestScore;
+        return best;
+    }
+
+    // Lazy SMP versions of bestMove and thinkTimed: helper threads run the same search on
+    // copies of this engine, which share its transposition table, and fill it with results
+    // the main search then picks up. The main search's answer is the one returned, so a
+    // full-depth result is exactly the serial one.
+    int bestMoveParallel(int threads, int* scoreOut = nullptr) {
+        return lazySmp(threads, [](BitEngine& e, int* score) { return e.bestMove(score); }, scoreOut);
+    }
+
+    int thinkParallel(int budgetMs, int threads, int* scoreOut = nullptr) {
+        return lazySmp(threads, [budgetMs](BitEngine& e, int* score) { return e.thinkTimed(budgetMs, score); },
+                       scoreOut);
+    }
+
+    // Heuristic score for the side to move: every line still open to only one side counts
+    // for that side, more steeply the fuller it is. Kept up to date by place(), so O(1).
+    int evaluate() const {
+        long long score = toMove == 0 ? lineScore : -lineScore;
+        return (int)max<long long>(-WIN_BOUND + 1, min<long long>(WIN_BOUND - 1, score));
+    }
+
+    // Whether the side that played cell c now owns a full line through it.
+    bool lastMoveWon(int c) const {
+        const Mask& mine = side[toMove ^ 1];
+        for (int l : geo.linesThrough[c])
+            if ((mine & geo.lines[l]) == geo.lines[l]) return true;
+        return false;
+    }
+
+    void make(int c) {
+        place(toMove, c);
+        toMove ^= 1;
+        ++ply;
+    }
+
+    void unmake(int c) {
+        toMove ^= 1;
+        --ply;
+        place(toMove, c);
+    }
+
+private:
+    Mask side[2];
+    int toMove = 0;
+    int ply = 0;
+    vector<uint64_t> zobrist;
+    uint64_t sideKey;
+    array<uint64_t, 8> keys;            // Zobrist key of the position seen through each symmetry
+    shared_ptr<TranspositionTable> tt;              // copies of the engine share it
+    int nearRadius = 0;
+    vector<Mask> around;
+    vector<long long> lineWeight;
+    vector<array<uint8_t, 2>> lineCount;            // marks of each side on each line
+    long long lineScore = 0;                        // sum of lineValue over all lines, side 0's view
+    array<array<int, 2>, MAX_PLY> killers;          // two quiet cut moves per ply
+    array<array<int, MAX_CELLS>, 2> history;        // cut count per side and cell, weighted by draft
+    bool timed = false;
+    bool stopped = false;
+    chrono::steady_clock::time_point deadline;
+    instr::Tally tally;                             // search's counters, flushed per root search
+
+    long long lineValue(int l) const {
+        int mine = lineCount[l][0], theirs = lineCount[l][1];
+        if (mine && theirs) return 0;
+        return lineWeight[mine] - lineWeight[theirs];
+    }
+
+    // Toggles a mark, so it serves for both placing and removing.
+    void place(int who, int c) {
+        int delta = side[who].test(c) ? -1 : 1;
+        side[who].flip(c);
+        for (int l : geo.linesThrough[c]) {
+            lineScore -= lineValue(l);
+            lineCount[l][who] += delta;
+            lineScore += lineValue(l);
+        }
+        for (int s = 0; s < geo.symCount; ++s) keys[s] ^= zobrist[2 * geo.sym[c][s] + who];
+    }
+
+    // Smallest key over all symmetries, so mirrored and rotated positions share an entry.
+    uint64_t canonicalKey(int& symOut) const {
+        uint64_t side = toMove ? sideKey : 0;
+        uint64_t best = keys[0] ^ side;
+        symOut = 0;
+        for (int s = 1; s < geo.symCount; ++s)
+            if ((keys[s] ^ side) < best) {
+                best = keys[s] ^ side;
+                symOut = s;
+            }
+        return best;
+    }
+
+    // Maps a canonical-orientation cell back to this position's orientation.
+    int fromCanonical(int cell, int s) const {
+        for (int c = 0; c < geo.cells; ++c)
+            if (geo.sym[c][s] == cell) return c;
+        return -1;
+    }
+
+    int probeMove() const {
+        int s;
+        uint64_t key = canonicalKey(s);
+        TTEntry e;
+        if (!tt->probe(key, e) || e.move < 0) return -1;
+        return fromCanonical(e.move, s);
+    }
+
+    template <class Job>
+    int lazySmp(int threads, Job job, int* scoreOut) {
+        atomic<bool> stop(false);
+        vector<BitEngine> helpers(max(0, threads - 1), *this);
+        vector<thread> pool;
+        for (size_t i = 0; i < helpers.size(); ++i) {
+            helpers[i].abortFlag = &stop;
+            helpers[i].helperId = i + 1;
+            helpers[i].nodes = 0;
+            pool.emplace_back([&job, &h = helpers[i]]() {
+                int ignored;
+                job(h, &ignored);
+            });
+        }
+        int best = job(*this, scoreOut);
+        stop.store(true, memory_order_relaxed);
+        for (auto& t : pool) t.join();
+        for (auto& h : helpers) nodes += h.nodes;
+        return best;
+    }
+
+    // TT move first, then this ply's killers, then the rest by history score.
+    vector<int> orderedMoves(int ttMove, int depth) const {
+        Mask candidates = ~(side[0] | side[1]) & geo.full;
+        if (nearRadius > 0) {
+            Mask occupied = side[0] | side[1];
+            if (occupied.none()) return {(geo.rows / 2) * geo.cols + geo.cols / 2};
+            Mask near;
+            for (int c = occupied._Find_first(); c < geo.cells; c = occupied._Find_next(c)) near |= around[c];
+            candidates &= near;
+        }
+
+        vector<pair<int, int>> scored;
+        for (int c = candidates._Find_first(); c < geo.cells; c = candidates._Find_next(c)) {
+            int key = history[toMove][c];
+            if (c == ttMove) key = INT_MAX;
+            else if (c == killers[depth][0]) key = INT_MAX - 1;
+            else if (c == killers[depth][1]) key = INT_MAX - 2;
+            scored.push_back({key, c});
+        }
+        stable_sort(scored.begin(), scored.end(), [](const pair<int, int>& a, const pair<int, int>& b) {
+            return a.first > b.first;
+        });
+        vector<int> moves;
+        moves.reserve(scored.size());
+        for (auto& sc : scored) moves.push_back(sc.second);
+        return moves;
+    }
+
+    // Searches every root move to the given draft, previous best first.
+    // Returns -1 if the deadline hit before the first move finished.
+    int rootSearch(int draft, int previousBest, int& scoreOut) {
+        int ttMove = previousBest >= 0 ? previousBest : probeMove();
+        int best = -1, bestScore = -WIN_SCORE - 1;
+        int alpha = -WIN_SCORE - 1, beta = WIN_SCORE + 1;
+        vector<int> moves = orderedMoves(ttMove, 0);
+        // Helpers take the root moves in a rotated order so they do not all trail the main thread.
+        if (helperId > 0 && !moves.empty())
+            rotate(moves.begin(), moves.begin() + helperId % moves.size(), moves.end());
+        for (int c : moves) {
+            make(c);
+            int v = lastMoveWon(c) ? WIN_SCORE - 1 : -search(1, draft - 1, -beta, -alpha);
+            unmake(c);
+            if (stopped) break;
+            if (v > bestScore) {
+                bestScore = v;
+                best = c;
+            }
+            alpha = max(alpha, v);
+        }
+        tally.flush();
+        scoreOut = bestScore;
+        return best;
+    }
+
+    // Negamax from the side to move, depth plies below the root with draft plies left.
+    // Wins are stored relative to the node, not the root, so a TT hit is valid at any ply.
+    int search(int depth, int draft, int alpha, int beta) {
+        ++nodes;
+        tally.add(instr::NODES_EXPANDED);
+        if ((nodes & 15) == 0 && ((abortFlag && abortFlag->load(memory_order_relaxed)) ||
+                                  (timed && chrono::steady_clock::now() >= deadline)))
+            stopped = true;
+        if (stopped) return 0;
+        if (ply == geo.cells) return 0;
+        if (draft <= 0) return evaluate();
+
+        int s;
+        uint64_t key = canonicalKey(s);
+        TTEntry e;
+        int ttMove = -1;
+        tally.add(instr::TABLE_PROBES);
+        if (tt->probe(key, e)) {
+            tally.add(instr::TABLE_HITS);
+            if (e.draft >= draft) {
+                int v = fromTT(e.value, depth);
+                if (e.bound == BOUND_EXACT) return v;
+                if (e.bound == BOUND_LOWER && v >= beta) return v;
+                if (e.bound == BOUND_UPPER && v <= alpha) return v;
+            }
+            if (e.move >= 0) ttMove = fromCanonical(e.move, s);
+        }
+
+        int alphaOrig = alpha;
+        int best = -WIN_SCORE - 1, bestCell = -1;
+        for (int c : orderedMoves(ttMove, depth)) {
+            make(c);
+            tally.add(instr::NODES_GENERATED);
+            int v = lastMoveWon(c) ? WIN_SCORE - depth - 1 : -search(depth + 1, draft - 1, -beta, -alpha);
+            unmake(c);
+            if (stopped) return 0;
+            if (v > best) {
+                best = v;
+                bestCell = c;
+            }
+            alpha = max(alpha, v);
+            if (alpha >= beta) {
+                tally.add(instr::PRUNED);
+                if (c != killers[depth][0]) {
+                    killers[depth][1] = killers[depth][0];
+                    killers[depth][0] = c;
+                }
+                history[toMove][c] += draft * draft;
+                break;
+            }
+        }
+
+        e.key = key;
+        e.value = toTT(best, depth);
+        e.move = geo.sym[bestCell][s];
+        e.draft = draft;
+        e.bound = best <= alphaOrig ? BOUND_UPPER : best >= beta ? BOUND_LOWER : BOUND_EXACT;
+        tt->store(e);
+        return best;
+    }
+
+    static int toTT(int v, int depth) {
+        if (v > WIN_BOUND) return v + depth;
+        if (v < -WIN_BOUND) return v - depth;
+        return v;
+    }
+
+    static int fromTT(int v, int depth) {
+        if (v > WIN_BOUND) return v - depth;
+        if (v < -WIN_BOUND) return v + depth;
+        return v;
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Solved position table
+// ---------------------------------------------------------------------------
+// Perfect play for the positions of an m,n,k board that hold at least minPieces
+// marks, one 16-bit entry per position. minPieces = 0 covers the whole game; a
+// larger value keeps only the endgame, which is what fits for bigger boards.
+//
+// Positions are seen from the side to move and stored in one array per mark count
+// p. With p marks the mover has p/2 of them (rounded down) and the opponent the
+// rest, so a layer holds C(cells, p) * C(p, p/2) entries: the colex rank of the
+// occupied cells, then the colex rank of the mover's marks among them. The same
+// table serves whoever moved first.
+
+const int MAX_TABLE_CELLS = 63;                     // cell numbers fit a 64-bit mask and the move byte
+const uint64_t MAX_TABLE_ENTRIES = 1ULL << 30;      // 2 GB of entries
+
+class SolvedTable {
+public:
+    enum Outcome { DRAW = 0, WIN = 1, LOSS = 2, INVALID = 3 };
+
+    int rows = 0, cols = 0, k = 0, minPieces = 0;
+    vector<vector<uint16_t>> layers;    // layers[p] for p >= minPieces; entry bits 0-7 best move
+                                        // (255 none), 8-13 plies to the end, 14-15 Outcome
+
+    bool loaded() const { return !layers.empty(); }
+
+    // Entries in the layer of positions with p marks on a board of cells cells.
+    static uint64_t layerSize(int cells, int p) { return choose(cells, p) * choose(p, p / 2); }
+
+    static uint64_t totalEntries(int cells, int fromPieces) {
+        uint64_t total = 0;
+        for (int p = max(fromPieces, 0); p <= cells; ++p) total += layerSize(cells, p);
+        return total;
+    }
+
+    // Index of a position within its layer: own and opp are the mover's and the
+    // opponent's marks.
+    static uint64_t rank(uint64_t own, uint64_t opp) {
+        uint64_t occupied = own | opp;
+        int p = __builtin_popcountll(occupied);
+        uint64_t r = 0, s = 0;
+        int i = 0, j = 0;
+        for (uint64_t x = occupied; x; x &= x - 1, ++i) {
+            uint64_t bit = x & (~x + 1);
+            r += choose(__builtin_ctzll(bit), i + 1);
+            if (own & bit) s += choose(i, ++j);
+        }
+        return r * choose(p, p / 2) + s;
+    }
+
+    static Outcome outcome(uint16_t e) { return Outcome(e >> 14); }
+    static int distance(uint16_t e) { return (e >> 8) & 0x3F; }
+    static int move(uint16_t e) { return (e & 0xFF) == 0xFF ? -1 : (e & 0xFF); }
+
+    // Entry for the position, or an INVALID one when the table does not cover it.
+    uint16_t lookup(const vector<char>& board, char stm) const {
+        if (!loaded() || (int)board.size() != rows * cols) return pack(INVALID, 0, -1);
+        uint64_t own = 0, opp = 0;
+        for (int c = 0; c < (int)board.size(); ++c) {
+            if (board[c] == stm) own |= 1ULL << c;
+            else if (board[c] != EMPTY) opp |= 1ULL << c;
+        }
+        int p = __builtin_popcountll(own | opp);
+        if (p < minPieces || __builtin_popcountll(own) != p / 2) return pack(INVALID, 0, -1);
+        return layers[p][rank(own, opp)];
+    }
+
+    // Best move for stm, or -1 when the position is not in the table or the game is over.
+    int bestMove(const vector<char>& board, char stm) const {
+        uint16_t e = lookup(board, stm);
+        return outcome(e) == INVALID ? -1 : move(e);
+    }
+
+    // Retrograde solve: a position's children all hold one more mark, so sweeping from
+    // full boards down to minPieces marks finds every child solved before its parent.
+    bool build(int m, int n, int lineLength, int fromPieces = 0) {
+        int cells = m * n;
+        if (cells > MAX_TABLE_CELLS || totalEntries(cells, fromPieces) > MAX_TABLE_ENTRIES) return false;
+        rows = m, cols = n, k = lineLength, minPieces = max(fromPieces, 0);
+        Geometry geo(m, n, k);
+        vector<uint64_t> lines;
+        for (const Mask& line : geo.lines) lines.push_back(line.to_ullong());
+        auto hasLine = [&](uint64_t mask) {
+            for (uint64_t l : lines) if ((mask & l) == l) return true;
+            return false;
+        };
+
+        layers.assign(cells + 1, {});
+        for (int p = cells; p >= minPieces; --p) {
+            int a = p / 2;
+            vector<uint16_t>& layer = layers[p];
+            layer.assign(layerSize(cells, p), pack(INVALID, 0, -1));
+            uint64_t index = 0;
+            // Occupied sets and the mover's share of them both come in colex order, which
+            // is the order rank() numbers them in.
+            for (uint64_t occupied = p ? (1ULL << p) - 1 : 0;; occupied = nextSubset(occupied)) {
+                for (uint64_t pick = a ? (1ULL << a) - 1 : 0;; pick = nextSubset(pick)) {
+                    uint64_t own = deposit(pick, occupied), opp = occupied & ~own;
+                    layer[index++] = solve(own, opp, cells, hasLine);
+                    if (pick == ((1ULL << a) - 1) << (p - a)) break;
+                }
+                if (occupied == ((1ULL << p) - 1) << (cells - p)) break;
+            }
+        }
+        return true;
+    }
+
+    // File layout: "MNKT", version, rows, cols, k, minPieces, entry count, then the
+    // layers from minPieces marks up to a full board (little endian).
+    bool save(const string& path) const {
+        ofstream out(path, ios::binary);
+        uint32_t header[5] = {TABLE_VERSION, (uint32_t)rows, (uint32_t)cols, (uint32_t)k, (uint32_t)minPieces};
+        uint64_t count = totalEntries(rows * cols, minPieces);
+        out.write("MNKT", 4);
+        out.write(reinterpret_cast<const char*>(header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        for (int p = minPieces; p <= rows * cols; ++p)
+            out.write(reinterpret_cast<const char*>(layers[p].data()), layers[p].size() * sizeof(uint16_t));
+        return bool(out);
+    }
+
+    bool load(const string& path) {
+        ifstream in(path, ios::binary);
+        char magic[4];
+        uint32_t header[5];
+        uint64_t count;
+        if (!in.read(magic, 4) || memcmp(magic, "MNKT", 4) != 0) return false;
+        if (!in.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != TABLE_VERSION) return false;
+        if (!in.read(reinterpret_cast<char*>(&count), sizeof(count))) return false;
+        int cells = header[1] * header[2], from = header[4];
+        if (cells > MAX_TABLE_CELLS || from > cells || count != totalEntries(cells, from)) return false;
+        vector<vector<uint16_t>> data(cells + 1);
+        for (int p = from; p <= cells; ++p) {
+            data[p].resize(layerSize(cells, p));
+            if (!in.read(reinterpret_cast<char*>(data[p].data()), data[p].size() * sizeof(uint16_t))) return false;
+        }
+        rows = header[1], cols = header[2], k = header[3], minPieces = from;
+        layers.swap(data);
+        return true;
+    }
+
+private:
+    static const uint32_t TABLE_VERSION = 2;
+
+    static uint16_t pack(Outcome o, int dist, int move) {
+        return uint16_t(o << 14 | (dist & 0x3F) << 8 | (move < 0 ? 0xFF : move));
+    }
+
+    static uint64_t choose(int n, int r) {
+        static const auto table = [] {
+            array<array<uint64_t, 65>, 65> c{};
+            for (int i = 0; i <= 64; ++i) {
+                c[i][0] = 1;
+                for (int j = 1; j <= i; ++j) c[i][j] = c[i - 1][j - 1] + c[i - 1][j];
+            }
+            return c;
+        }();
+        return r < 0 || r > n ? 0 : table[n][r];
+    }
+
+    // Next larger mask with the same number of bits (Gosper's hack).
+    static uint64_t nextSubset(uint64_t x) {
+        uint64_t low = x & (~x + 1), ripple = x + low;
+        return ripple | (((x ^ ripple) >> 2) / low);
+    }
+
+    // Spreads the low bits of pick over the set bits of where, lowest first.
+    static uint64_t deposit(uint64_t pick, uint64_t where) {
+        uint64_t out = 0;
+        for (; pick && where; pick >>= 1, where &= where - 1)
+            if (pick & 1) out |= where & (~where + 1);
+        return out;
+    }
+
+    // Entry for the mover holding own against opp, from the already solved layer above.
+    template <typename HasLine>
+    uint16_t solve(uint64_t own, uint64_t opp, int cells, const HasLine& hasLine) const {
+        // Legal when nobody won before this turn except possibly the opponent on the move
+        // just made.
+        if (hasLine(own)) return pack(INVALID, 0, -1);
+        if (hasLine(opp)) return pack(LOSS, 0, -1);
+        if (__builtin_popcountll(own | opp) == cells) return pack(DRAW, 0, -1);
+
+        const vector<uint16_t>& next = layers[__builtin_popcountll(own | opp) + 1];
+        int bestScore = INT_MIN, bestCell = -1, bestDist = 0;
+        Outcome bestOutcome = DRAW;
+        for (int c = 0; c < cells; ++c) {
+            if (((own | opp) >> c) & 1) continue;
+            // The child is seen from the opponent, who moves next.
+            uint16_t child = next[rank(opp, own | 1ULL << c)];
+            Outcome o = outcome(child) == LOSS ? WIN : outcome(child) == WIN ? LOSS : DRAW;
+            int dist = distance(child) + 1;
+            // Prefer quick wins and slow losses, as minimax's depth term does.
+            int score = o == WIN ? 100 - dist : o == LOSS ? dist - 100 : 0;
+            if (score > bestScore) {
+                bestScore = score;
+                bestCell = c;
+                bestDist = dist;
+                bestOutcome = o;
+            }
+        }
+        return pack(bestOutcome, bestDist, bestCell);
+    }
+};
+
+const char* TABLE_PATH = "ttt_table.bin";
+SolvedTable solvedTable;    // loaded by main; empty means fall back to search
+
+// Same interface as before. With the solved table loaded a move is one lookup;
+// otherwise the bitboard engine searches, keeping its table across turns.
+int findBestMove(vector<char>& board) {
+    int move = solvedTable.bestMove(board, AI);
+    if (move >= 0) return move;
+    static BitEngine engine(3, 3, 3, 16);
+    engine.setBoard(board, AI);
+    return engine.bestMove();
+}
+
+// ---------------------------------------------------------------------------
+// Monte Carlo tree search
+// ---------------------------------------------------------------------------
+// UCT for boards too large to search to the end. Nodes come from one preallocated
+// pool, and each node's children sit in one contiguous block of it. Playouts are
+// random moves on the two side masks. Several threads descend the same tree at
+// once, and virtual loss steers them onto different branches.
+
+struct MctsNode {
+    atomic<int> visits{0};
+    atomic<int> score{0};           // 2 per win, 1 per draw, for the player who moved into the node
+    atomic<uint8_t> state{0};       // 0 leaf, 1 being expanded, 2 children ready
+    int16_t move = -1;
+    uint16_t childCount = 0;
+    int32_t firstChild = -1;
+};
+
+class MctsEngine {
+public:
+    Geometry geo;
+    long long playouts = 0;         // playouts run by the last search
+    double exploration = 1.4;
+    int virtualLoss = 3;
+
+    MctsEngine(int rows, int cols, int k, size_t poolSize = size_t(1) << 21)
+        : geo(rows, cols, k), pool(new MctsNode[poolSize]), poolSize(poolSize) {}
+
+    // Only expand children within this distance of a mark (0 = every empty cell).
+    void setNearRadius(int radius) {
+        nearRadius = radius;
+        around = geo.neighbourhood(radius);
+    }
+
+    // Most visited root move after budgetMs of search on the given number of threads;
+    // -1 only when the board is full.
+    int search(const vector<char>& board, char stm, int budgetMs, int threads = 1) {
+        rootSide[0].reset();
+        rootSide[1].reset();
+        for (int c = 0; c < geo.cells; ++c) {
+            if (board[c] == stm) rootSide[0].set(c);
+            else if (board[c] != EMPTY) rootSide[1].set(c);
+        }
+        rootPly = rootSide[0].count() + rootSide[1].count();
+        if (rootPly == geo.cells) return -1;
+
+        used.store(1);
+        resetNode(pool[0], -1);
+        // Expanded before the clock starts, so even a search that runs out of time at
+        // once has a legal move to return.
+        if (!expand(pool[0], rootSide)) {
+            playouts = 0;
+            return (~(rootSide[0] | rootSide[1]) & geo.full)._Find_first();
+        }
+        atomic<long long> total(0);
+        auto deadline = chrono::steady_clock::now() + chrono::milliseconds(budgetMs);
+        auto run = [&](uint64_t seed) { total += worker(deadline, seed); };
+
+        vector<thread> workers;
+        for (int t = 1; t < threads; ++t) workers.emplace_back(run, 0x5851F42D4C957F2DULL * (t + 1) + rng());
+        run(rng());
+        for (auto& t : workers) t.join();
+        playouts = total;
+
+        const MctsNode& root = pool[0];
+        int best = -1, bestVisits = -1;
+        for (int i = 0; i < root.childCount; ++i) {
+            const MctsNode& child = pool[root.firstChild + i];
+            if (child.visits.load() > bestVisits) {
+                bestVisits = child.visits.load();
+                best = child.move;
+            }
+        }
+        return best;
+    }
+
+private:
+    unique_ptr<MctsNode[]> pool;
+    size_t poolSize;
+    atomic<size_t> used{0};
+    Mask rootSide[2];               // index 0 is the side to move at the root
+    int rootPly = 0;
+    int nearRadius = 0;
+    vector<Mask> around;
+    mt19937_64 rng{12345};
+
+    static void resetNode(MctsNode& n, int move) {
+        n.visits.store(0, memory_order_relaxed);
+        n.score.store(0, memory_order_relaxed);
+        n.state.store(0, memory_order_relaxed);
+        n.move = move;
+        n.childCount = 0;
+        n.firstChild = -1;
+    }
+
+    bool won(const Mask& mine, int c) const {
+        for (int l : geo.linesThrough[c])
+            if ((mine & geo.lines[l]) == geo.lines[l]) return true;
+        return false;
+    }
+
+    // Claims one contiguous block of the pool for node's children. Returns false when
+    // another thread is already expanding it or the pool is full.
+    bool expand(MctsNode& node, const Mask side[2]) {
+        uint8_t expected = 0;
+        if (!node.state.compare_exchange_strong(expected, 1, memory_order_acquire)) return false;
+        Mask occupied = side[0] | side[1];
+        Mask candidates = ~occupied & geo.full;
+        if (nearRadius > 0) {
+            Mask near;
+            if (occupied.none()) near.set((geo.rows / 2) * geo.cols + geo.cols / 2);
+            for (int c = occupied._Find_first(); c < geo.cells; c = occupied._Find_next(c)) near |= around[c];
+            candidates &= near;
+        }
+        size_t count = candidates.count();
+        size_t first = used.fetch_add(count);
+        if (count == 0 || first + count > poolSize) {
+            node.state.store(0, memory_order_release);
+            return false;
+        }
+        size_t i = first;
+        for (int c = candidates._Find_first(); c < geo.cells; c = candidates._Find_next(c)) resetNode(pool[i++], c);
+        node.firstChild = first;
+        node.childCount = count;
+        node.state.store(2, memory_order_release);
+        INSTR_COUNT(NODES_EXPANDED);
+        INSTR_ADD(NODES_GENERATED, count);
+        return true;
+    }
+
+    int selectChild(const MctsNode& node) const {
+        double logN = log(max(1, node.visits.load(memory_order_relaxed)));
+        int best = 0;
+        double bestValue = -1;
+        for (int i = 0; i < node.childCount; ++i) {
+            const MctsNode& child = pool[node.firstChild + i];
+            int v = child.visits.load(memory_order_relaxed);
+            if (v == 0) return i;
+            double value = child.score.load(memory_order_relaxed) / (2.0 * v) + exploration * sqrt(logN / v);
+            if (value > bestValue) {
+                bestValue = value;
+                best = i;
+            }
+        }
+        return best;
+    }
+
+    // Plays random moves to the end. Returns the winner (0 or 1) or 2 for a draw.
+    int playout(Mask side[2], int toMove, int ply, mt19937_64& gen, vector<int>& empties) const {
+        empties.clear();
+        Mask free = ~(side[0] | side[1]) & geo.full;
+        for (int c = free._Find_first(); c < geo.cells; c = free._Find_next(c)) empties.push_back(c);
+        for (; ply < geo.cells; ++ply) {
+            size_t pick = gen() % empties.size();
+            int c = empties[pick];
+            empties[pick] = empties.back();
+            empties.pop_back();
+            side[toMove].set(c);
+            if (won(side[toMove], c)) return toMove;
+            toMove ^= 1;
+        }
+        return 2;
+    }
+
+    long long worker(chrono::steady_clock::time_point deadline, uint64_t seed) {
+        mt19937_64 gen(seed);
+        vector<int> path, empties;
+        long long done = 0;
+        while (chrono::steady_clock::now() < deadline) {
+            Mask side[2] = {rootSide[0], rootSide[1]};
+            int toMove = 0, ply = rootPly, result = -1;
+            MctsNode* node = &pool[0];
+            path.assign(1, 0);
+
+            auto descend = [&](int index) {
+                MctsNode& child = pool[index];
+                child.visits.fetch_add(virtualLoss, memory_order_relaxed);
+                side[toMove].set(child.move);
+                if (won(side[toMove], child.move)) result = toMove;
+                else if (++ply == geo.cells) result = 2;
+                toMove ^= 1;
+                path.push_back(index);
+                node = &child;
+            };
+
+            while (result < 0 && node->state.load(memory_order_acquire) == 2)
+                descend(node->firstChild + selectChild(*node));
+
+            // Grow the tree at leaves that have been visited before, then roll out from one new child.
+            if (result < 0 && (node == &pool[0] || node->visits.load(memory_order_relaxed) > virtualLoss) &&
+                expand(*node, side))
+                descend(node->firstChild + gen() % node->childCount);
+            if (result < 0) result = playout(side, toMove, ply, gen, empties);
+
+            pool[0].visits.fetch_add(1, memory_order_relaxed);
+            for (size_t d = 1; d < path.size(); ++d) {
+                MctsNode& n = pool[path[d]];
+                int mover = (d - 1) & 1;
+                n.visits.fetch_add(1 - virtualLoss, memory_order_relaxed);
+                n.score.fetch_add(result == 2 ? 1 : result == mover ? 2 : 0, memory_order_relaxed);
+            }
+            ++done;
+        }
+        return done;
+    }
+};
+
+// findBestMove with MCTS in place of minimax.
+int findBestMoveMcts(vector<char>& board, int budgetMs = 100) {
+    static MctsEngine engine(3, 3, 3);
+    return engine.search(board, AI, budgetMs);
+}
+
+// Engine-vs-engine game on an m,n,k board with a fixed time budget per move.
+// Reports the depth reached and the slowest answer so the budget can be checked.
+void selfPlay(int m, int n, int k, int budgetMs) {
+    BitEngine engine(m, n, k, 22);
+    if (m * n > 25) engine.setNearRadius(2);
+    vector<char> board(m * n, EMPTY);
+    char turn = AI;
+    double slowest = 0;
+    cout << m << "x" << n << " board, " << k << " in a row, " << budgetMs << " ms per move\n";
+
+    for (int moveNo = 1; moveNo <= m * n; ++moveNo) {
+        engine.setBoard(board, turn);
+        long long before = engine.nodes;
+        auto t0 = chrono::steady_clock::now();
+        int score;
+        int move = engine.thinkTimed(budgetMs, &score);
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+        slowest = max(slowest, ms);
+        board[move] = turn;
+        cout << setw(3) << moveNo << ". " << turn << " (" << move / n << "," << move % n << ")"
+             << "  depth " << setw(2) << engine.completedDepth << "  nodes " << setw(8) << engine.nodes - before
+             << "  " << fixed << setprecision(1) << ms << " ms  eval " << score << "\n";
+
+        engine.make(move);
+        if (engine.lastMoveWon(move)) {
+            cout << turn << " wins.\n";
+            break;
+        }
+        if (moveNo == m * n) cout << "Draw.\n";
+        turn = turn == AI ? HUMAN : AI;
+    }
+    cout << "Slowest move: " << fixed << setprecision(1) << slowest << " ms\n";
+}
+
+// Engine scores count plies from the root; minimax counts from after the root move and
+// uses +-10. Converts a full-depth engine score to what findBestMoveMinimax would report.
+int toMinimaxScale(int score) {
+    if (score > WIN_BOUND) return score - WIN_SCORE + 11;
+    if (score < -WIN_BOUND) return score + WIN_SCORE - 11;
+    return 0;
+}
+
+// Checks the parallel full-depth search against serial minimax on every reachable 3x3
+// position with the AI to move, and against the serial engine on the empty 4x4 board.
+bool verifyParallelSearch(int threads) {
+    set<vector<char>> seen;
+    vector<vector<char>> positions;
+    function<void(vector<char>&, char)> collect = [&](vector<char>& b, char turn) {
+        if (checkWinner(b) != 0 || !isMovesLeft(b) || !seen.insert(b).second) return;
+        if (turn == AI) positions.push_back(b);
+        for (int i = 0; i < 9; ++i)
+            if (b[i] == EMPTY) {
+                b[i] = turn;
+                collect(b, turn == AI ? HUMAN : AI);
+                b[i] = EMPTY;
+            }
+    };
+    vector<char> empty(9, EMPTY);
+    collect(empty, AI);
+    seen.clear();
+    collect(empty, HUMAN);
+
+    BitEngine engine(3, 3, 3, 16);
+    int mismatches = 0;
+    for (auto& b : positions) {
+        int expected = INT_MIN;
+        vector<int> moveVal(9, INT_MIN);
+        for (int i = 0; i < 9; ++i)
+            if (b[i] == EMPTY) {
+                b[i] = AI;
+                moveVal[i] = minimax(b, 0, false, INT_MIN, INT_MAX);
+                b[i] = EMPTY;
+                expected = max(expected, moveVal[i]);
+            }
+        engine.setBoard(b, AI);
+        int score;
+        int move = engine.bestMoveParallel(threads, &score);
+        if (toMinimaxScale(score) != expected || moveVal[move] != expected) ++mismatches;
+    }
+    cout << "3x3: " << positions.size() << " positions, " << mismatches << " mismatches against minimax\n";
+
+    BitEngine serial(4, 4, 4, 22), parallel(4, 4, 4, 22);
+    int serialScore, parallelScore;
+    serial.bestMove(&serialScore);
+    parallel.bestMoveParallel(threads, &parallelScore);
+    cout << "4x4x4: serial " << serialScore << ", parallel " << parallelScore << "\n";
+    if (serialScore != parallelScore) ++mismatches;
+
+    cout << (mismatches == 0 ? "PASS" : "FAIL") << " (" << threads << " threads)\n";
+    return mismatches == 0;
+}
+
+// Nodes per second of the Lazy SMP search from the empty board for 1, 2, 4, ... threads.
+void smpBenchmark(int m, int n, int k, int budgetMs) {
+    int hw = max(1u, thread::hardware_concurrency());
+    vector<int> counts;
+    for (int t = 1; t < hw; t *= 2) counts.push_back(t);
+    counts.push_back(hw);
+
+    cout << m << "x" << n << " board, " << k << " in a row, " << budgetMs << " ms per search\n";
+    cout << "Threads | Nodes      | Nodes/s     | Scaling | Depth\n";
+    double baseNps = 0;
+    for (int t : counts) {
+        BitEngine engine(m, n, k, 22);
+        if (m * n > 25) engine.setNearRadius(2);
+        auto t0 = chrono::steady_clock::now();
+        engine.thinkParallel(budgetMs, t);
+        double sec = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        double nps = engine.nodes / sec;
+        if (baseNps == 0) baseNps = nps;
+        cout << setw(7) << t << " | " << setw(10) << engine.nodes << " | " << setw(11) << (long long)nps
+             << " | " << setw(6) << fixed << setprecision(2) << nps / baseNps << "x | " << engine.completedDepth << "\n";
+    }
+}
+
+// MCTS playouts per second for 1, 2, 4, ... threads, then games against the minimax
+// engines: plain minimax on 3x3 and the timed alpha-beta search on 7x7 with 4 in a row.
+void mctsBenchmark(int budgetMs) {
+    int hw = max(1u, thread::hardware_concurrency());
+    vector<int> counts;
+    for (int t = 1; t < hw; t *= 2) counts.push_back(t);
+    counts.push_back(hw);
+
+    cout << "Board     | Threads | Playouts   | Playouts/s\n";
+    int boards[3][3] = {{3, 3, 3}, {7, 7, 4}, {15, 15, 5}};
+    for (auto& b : boards)
+        for (int t : counts) {
+            MctsEngine engine(b[0], b[1], b[2]);
+            engine.search(vector<char>(b[0] * b[1], EMPTY), AI, budgetMs, t);
+            cout << setw(2) << b[0] << "x" << setw(2) << b[1] << " k" << b[2] << " | " << setw(7) << t << " | "
+                 << setw(10) << engine.playouts << " | " << (budgetMs > 0 ? (long long)(engine.playouts * 1000.0 / budgetMs) : 0) << "\n";
+        }
+
+    // MCTS always plays O; X is the opponent engine. Odd games let MCTS move first.
+    auto playMatch = [&](int m, int n, int k, int games, function<int(vector<char>&)> opponent) {
+        MctsEngine mcts(m, n, k);
+        Geometry geo(m, n, k);
+        int wins = 0, draws = 0, losses = 0;
+        for (int g = 0; g < games; ++g) {
+            vector<char> board(m * n, EMPTY);
+            char turn = g % 2 ? HUMAN : AI;
+            char winner = 0;
+            for (int ply = 0; ply < m * n && !winner; ++ply) {
+                int move = turn == HUMAN ? mcts.search(board, HUMAN, budgetMs) : opponent(board);
+                // An engine that ran out of time without a move plays the first empty cell.
+                if (move < 0 || move >= m * n || board[move] != EMPTY)
+                    move = find(board.begin(), board.end(), EMPTY) - board.begin();
+                board[move] = turn;
+                for (int l : geo.linesThrough[move]) {
+                    bool full = true;
+                    for (int c = geo.lines[l]._Find_first(); c < geo.cells; c = geo.lines[l]._Find_next(c))
+                        full = full && board[c] == turn;
+                    if (full) winner = turn;
+                }
+                turn = turn == AI ? HUMAN : AI;
+            }
+            if (winner == HUMAN) ++wins;
+            else if (winner == AI) ++losses;
+            else ++draws;
+        }
+        cout << m << "x" << n << " k" << k << ": MCTS won " << wins << ", drew " << draws << ", lost " << losses
+             << " of " << games << "\n";
+    };
+
+    playMatch(3, 3, 3, 10, [](vector<char>& b) { return findBestMoveMinimax(b); });
+    BitEngine alphaBeta(7, 7, 4, 22);
+    playMatch(7, 7, 4, 4, [&](vector<char>& b) {
+        alphaBeta.setBoard(b, AI);
+        return alphaBeta.thinkTimed(budgetMs);
+    });
+}
+
+int main(int argc, char* argv[]) {
     ios::sync_with_stdio(false);
     cin.tie(nullptr);
 
+    // "--build-table [m n k [minPieces]] [path]": numbers fill the board size and the
+    // fewest marks to cover, any other argument is the output file.
+    if (argc >= 2 && string(argv[1]) == "--build-table") {
+        vector<int> numbers = {3, 3, 3, 0};
+        size_t given = 0;
+        string path = TABLE_PATH;
+        for (int i = 2; i < argc; ++i) {
+            if (isdigit((unsigned char)argv[i][0]) && given < numbers.size()) numbers[given++] = atoi(argv[i]);
+            else path = argv[i];
+        }
+        int m = numbers[0], n = numbers[1], k = numbers[2], minPieces = numbers[3];
+        SolvedTable table;
+        if (!table.build(m, n, k, minPieces)) {
+            cout << m << "x" << n << " from " << minPieces << " marks needs "
+                 << SolvedTable::totalEntries(m * n, minPieces) << " entries; the table holds at most "
+                 << MAX_TABLE_ENTRIES << " on boards of up to " << MAX_TABLE_CELLS
+                 << " cells. Raise minPieces to keep less of the game.\n";
+            return 1;
+        }
+        long long entries = 0, legal = 0;
+        for (const auto& layer : table.layers) {
+            entries += layer.size();
+            legal += count_if(layer.begin(), layer.end(),
+                              [](uint16_t e) { return SolvedTable::outcome(e) != SolvedTable::INVALID; });
+        }
+        const char* names[] = {"draw", "win", "loss"};
+        cout << m << "x" << n << " board, " << k << " in a row, positions with at least " << table.minPieces
+             << " marks: " << legal << " legal of " << entries << " entries";
+        if (table.minPieces == 0)
+            cout << ", empty board is a " << names[SolvedTable::outcome(table.layers[0][0])] << " for the first player";
+        cout << "\n";
+        if (!table.save(path)) {
+            cout << "Could not write " << path << "\n";
+            return 1;
+        }
+        cout << "Wrote " << path << " (" << entries * sizeof(uint16_t) << " bytes of entries)\n";
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--json") {
+        // Each engine on a fixed job, one JSON line each in the schema of instrumentation.h.
+        int budgetMs = argc >= 3 ? atoi(argv[2]) : 200;
+        vector<char> board(9, EMPTY);
+        {
+            instr::Run run("minimax alpha-beta", "3x3 empty board");
+            run.extra("move", findBestMoveMinimax(board));
+            cout << run.finish() << "\n";
+        }
+        {
+            BitEngine engine(3, 3, 3, 16);
+            engine.setBoard(board, AI);
+            instr::Run run("bitboard negamax", "3x3 empty board, full solve");
+            int score;
+            run.extra("move", engine.bestMove(&score)).extra("score", score);
+            cout << run.finish() << "\n";
+        }
+        {
+            BitEngine engine(7, 7, 4, 22);
+            engine.setBoard(vector<char>(49, EMPTY), AI);
+            instr::Run run("bitboard negamax", "7x7 k=4 empty board, " + to_string(budgetMs) + " ms");
+            int score, move = engine.thinkTimed(budgetMs, &score);
+            run.extra("move", move).extra("score", score).extra("depth", engine.completedDepth);
+            cout << run.finish() << "\n";
+        }
+        {
+            MctsEngine engine(7, 7, 4);
+            instr::Run run("mcts", "7x7 k=4 empty board, " + to_string(budgetMs) + " ms");
+            int move = engine.search(vector<char>(49, EMPTY), AI, budgetMs);
+            run.extra("move", move).extra("playouts", engine.playouts);
+            cout << run.finish() << "\n";
+        }
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--mcts-bench") {
+        mctsBenchmark(argc >= 3 ? atoi(argv[2]) : 200);
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--smp-verify") {
+        int threads = argc >= 3 ? atoi(argv[2]) : max(2u, thread::hardware_concurrency());
+        return verifyParallelSearch(threads) ? 0 : 1;
+    }
+    if (argc >= 2 && string(argv[1]) == "--smp-bench") {
+        int budgetMs = argc >= 3 ? atoi(argv[2]) : 1000;
+        smpBenchmark(7, 7, 4, budgetMs);
+        smpBenchmark(15, 15, 5, budgetMs);
+        return 0;
+    }
+    if (argc == 6 && string(argv[1]) == "--mnk") {
+        selfPlay(atoi(argv[2]), atoi(argv[3]), atoi(argv[4]), atoi(argv[5]));
+        return 0;
+    }
+
+    if (!solvedTable.load(TABLE_PATH) || solvedTable.rows != 3 || solvedTable.cols != 3 || solvedTable.k != 3) {
+        solvedTable = SolvedTable();
+        cout << "(No " << TABLE_PATH << " found, the AI will search. Build it with --build-table.)\n";
+    }
+
     vector<char> board(9, EMPTY);
     cout << "Tic-Tac-Toe: You (O) vs AI (X)\n";
     cout << "Board positions are numbered 1..9 as:\n";
@@ -1,32 +1,187 @@
 #include <iostream>
 #include <vector>
 #include <cmath> // For std::abs
+#include <cstdint>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <algorithm>
+#include <iomanip>
+#include <fstream>
+#include <functional>
+#include <cstring>
+#include <random>
 
-// Define the size of the chessboard
-const int N = 8;
+#include "../common/instrumentation.h"
 
-// A counter for the number of solutions found
-int solutionCount = 0;
+// Default size of the chessboard; the solvers take the size from the board they are given.
+const int N = 8;
 
 /*
  * Function to print the chessboard configuration.
  * It takes a vector where the index represents the column
  * and the value at that index represents the row of the queen.
+ * The board is built in one string and written once, instead of
+ * one stream insertion per square.
  */
-void printSolution(const std::vector<int>& board) {
-    std::cout << "Solution " << ++solutionCount << ":\n";
-    for (int i = 0; i < N; ++i) {
-        for (int j = 0; j < N; ++j) {
-            if (board[j] == i) {
-                // If a queen is at (row i, col j)
-                std::cout << "Q ";
-            } else {
-                std::cout << ". ";
-            }
+void printSolution(const std::vector<int>& board, std::uint64_t number, std::ostream& out = std::cout) {
+    int n = board.size();
+    std::string text = "Solution " + std::to_string(number) + ":\n";
+    text.reserve(text.size() + n * (2 * n + 1) + 20);
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            // "Q " if a queen is at (row i, col j)
+            text += board[j] == i ? "Q " : ". ";
+        }
+        text += '\n';
+    }
+    text += "\n-----------------\n\n";
+    out.write(text.data(), text.size());
+}
+
+/*
+ * Where the solvers hand each solution they find. Every sink keeps its own count,
+ * so there is no global state and several solvers can run at the same time.
+ */
+class SolutionSink {
+public:
+    virtual ~SolutionSink() = default;
+
+    // board[col] = row of the queen in that column.
+    virtual void accept(const std::vector<int>& board) = 0;
+
+    // Called once after the search, e.g. to flush buffered output.
+    virtual void finish() {}
+
+    std::uint64_t count() const { return solutions; }
+
+protected:
+    std::uint64_t solutions = 0;
+};
+
+// Only counts.
+class CountingSink : public SolutionSink {
+public:
+    void accept(const std::vector<int>&) override { ++solutions; }
+};
+
+// The original output: every board drawn in ASCII.
+class PrintingSink : public SolutionSink {
+public:
+    explicit PrintingSink(std::ostream& out = std::cout) : out(out) {}
+
+    void accept(const std::vector<int>& board) override { printSolution(board, ++solutions, out); }
+
+private:
+    std::ostream& out;
+};
+
+// Hands each board to a function inside the process.
+class CallbackSink : public SolutionSink {
+public:
+    explicit CallbackSink(std::function<void(const std::vector<int>&)> callback) : callback(std::move(callback)) {}
+
+    void accept(const std::vector<int>& board) override {
+        ++solutions;
+        callback(board);
+    }
+
+private:
+    std::function<void(const std::vector<int>&)> callback;
+};
+
+/*
+ * Compact binary stream of row vectors, collected in a large buffer and written
+ * out in big blocks. File layout: "NQS1", uint32 N, uint32 flags, then one record
+ * per solution with one byte per column (two when N > 256).
+ * With COMPRESS set a record starts with the number of leading columns it shares
+ * with the previous solution, and only the remaining columns follow. The solvers
+ * enumerate in order, so consecutive solutions share long prefixes.
+ */
+class BinaryStreamSink : public SolutionSink {
+public:
+    static const std::uint32_t COMPRESS = 1;
+
+    BinaryStreamSink(std::ostream& out, int n, bool compress, size_t bufferBytes = 1 << 20)
+        : out(out), n(n), wide(n > 256), compress(compress), previous(n, -1) {
+        buffer.reserve(bufferBytes);
+        std::uint32_t header[2] = {(std::uint32_t)n, compress ? COMPRESS : 0};
+        out.write("NQS1", 4);
+        out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    }
+
+    ~BinaryStreamSink() override { finish(); }
+
+    void accept(const std::vector<int>& board) override {
+        ++solutions;
+        int shared = 0;
+        if (compress) {
+            while (shared < n && board[shared] == previous[shared]) ++shared;
+            put(shared);
+            std::copy(board.begin() + shared, board.end(), previous.begin() + shared);
         }
-        std::cout << "\n";
+        for (int col = shared; col < n; ++col) put(board[col]);
+        if (buffer.size() + 2 * (n + 1) > buffer.capacity()) flush();
+    }
+
+    void finish() override { flush(); }
+
+    std::uint64_t bytesWritten() const { return written; }
+
+private:
+    std::ostream& out;
+    int n;
+    bool wide;
+    bool compress;
+    std::vector<int> previous;
+    std::vector<char> buffer;
+    std::uint64_t written = 12;
+
+    void put(int value) {
+        buffer.push_back(char(value & 0xFF));
+        if (wide) buffer.push_back(char(value >> 8));
     }
-    std::cout << "\n-----------------\n\n";
+
+    void flush() {
+        out.write(buffer.data(), buffer.size());
+        written += buffer.size();
+        buffer.clear();
+    }
+};
+
+/*
+ * Reads a stream written by BinaryStreamSink and hands every board to visit.
+ * Returns the number of solutions, or -1 if the header is not recognised.
+ */
+long long readSolutionStream(std::istream& in, const std::function<void(const std::vector<int>&)>& visit) {
+    char magic[4];
+    std::uint32_t header[2];
+    if (!in.read(magic, 4) || std::memcmp(magic, "NQS1", 4) != 0) return -1;
+    if (!in.read(reinterpret_cast<char*>(header), sizeof(header))) return -1;
+    int n = header[0];
+    bool wide = n > 256, compress = header[1] & BinaryStreamSink::COMPRESS;
+    auto get = [&](int& value) {
+        unsigned char b[2] = {0, 0};
+        if (!in.read(reinterpret_cast<char*>(b), wide ? 2 : 1)) return false;
+        value = b[0] | b[1] << 8;
+        return true;
+    };
+
+    std::vector<int> board(n);
+    long long count = 0;
+    while (true) {
+        int shared = 0;
+        if (compress && !get(shared)) break;
+        bool complete = true;
+        for (int col = shared; col < n && complete; ++col) complete = get(board[col]);
+        if (!complete) break;
+        visit(board);
+        ++count;
+    }
+    return count;
 }
 
 /*
@@ -58,33 +213,690 @@ bool isSafe(const std::vector<int>& board, int row, int col) {
 
 /*
  * The main recursive function to solve the N-Queens problem using backtracking.
- * board: The current board configuration.
+ * board: The current board configuration; its size is N.
  * col: The current column we are trying to place a queen in.
+ * sink: Receives every complete solution.
  */
-void solveNQueens(std::vector<int>& board, int col) {
+void solveNQueens(std::vector<int>& board, int col, SolutionSink& sink) {
+    int n = board.size();
+
     // Base case: If all queens have been placed successfully (i.e., we've filled all columns)
-    if (col >= N) {
-        printSolution(board);
+    if (col >= n) {
+        sink.accept(board);
         return; // Return to find other solutions
     }
+    INSTR_COUNT(NODES_EXPANDED);
 
     // Recursive step: Try placing a queen in each row of the current column
-    for (int i = 0; i < N; ++i) {
+    for (int i = 0; i < n; ++i) {
         // Check if placing a queen at (row i, col) is safe
         if (isSafe(board, i, col)) {
             // If it's safe, place the queen
             board[col] = i;
+            INSTR_COUNT(NODES_GENERATED);
 
             // Recur to place the rest of the queens in the next column
-            solveNQueens(board, col + 1);
+            solveNQueens(board, col + 1, sink);
 
             // Backtrack: If the recursive call doesn't lead to a solution,
             // this position is implicitly undone by the loop trying the next row 'i'.
+            INSTR_COUNT(BACKTRACKS);
+        } else {
+            INSTR_COUNT(PRUNED);
         }
     }
 }
 
-int main() {
+/*
+ * Bitmask counting engine for any N up to 63.
+ * Instead of looping over earlier columns like isSafe, the rows and both diagonal
+ * directions already attacked are kept as three bitmasks, so the free rows of the
+ * next column are one expression and each is taken off with the lowest-set-bit trick.
+ * Boards are never stored, only counted.
+ */
+class NQueensCounter {
+public:
+    explicit NQueensCounter(int n) : n(n), mask(n >= 64 ? ~0ULL : (1ULL << n) - 1), board(n > 0 ? n : 1) {}
+
+    /*
+     * Total number of solutions using the mirror symmetry only: every solution with
+     * the first queen in the lower half of column 0 has a mirror image in the upper
+     * half, so only the lower half is searched and counted twice.
+     */
+    std::uint64_t countAll() {
+        if (n <= 0) return 0;
+        if (n == 1) return 1;
+        std::uint64_t total = 0;
+        instr::Tally tally;
+        for (int row = 0; row < n / 2; ++row) {
+            std::uint64_t bit = 1ULL << row;
+            total += 2 * countFrom(1, bit, bit << 1, bit >> 1, tally);
+        }
+        if (n % 2 == 1) {
+            // First queen in the middle row: split on the second column instead,
+            // which cannot use the middle row either.
+            std::uint64_t mid = 1ULL << (n / 2);
+            std::uint64_t free = mask & ~(mid | mid << 1 | mid >> 1) & (mid - 1);
+            while (free) {
+                std::uint64_t bit = free & (~free + 1);
+                free ^= bit;
+                total += 2 * countFrom(2, mid | bit, (mid << 1 | bit) << 1, (mid >> 1 | bit) >> 1, tally);
+            }
+        }
+        tally.flush();
+        return total;
+    }
+
+    /*
+     * Hands every solution to sink, in the same order as solveNQueens, using the
+     * bitmask search instead of isSafe.
+     */
+    void enumerate(SolutionSink& sink) {
+        if (n <= 0) return;
+        std::vector<int> rows(n);
+        enumerateFrom(0, 0, 0, 0, rows, sink);
+        sink.finish();
+    }
+
+    /*
+     * Same count as countAll, split over threads. The boards of the first few
+     * columns are enumerated up front and each becomes an independent task.
+     * Tasks are dealt round robin into per-thread deques; a thread works from the
+     * back of its own deque and steals from the front of the others when it runs
+     * dry. Each thread counts into its own cache line and the counts are only added
+     * up after the threads are joined, so nothing is shared while searching.
+     */
+    std::uint64_t countAllParallel(int threads) {
+        if (n <= 2 || threads <= 1) return countAll();
+
+        std::vector<Task> tasks;
+        for (int row = 0; row < n / 2; ++row) {
+            std::uint64_t bit = 1ULL << row;
+            tasks.push_back({1, bit, bit << 1, bit >> 1, 2});
+        }
+        if (n % 2 == 1) {
+            std::uint64_t mid = 1ULL << (n / 2);
+            tasks.push_back({1, mid, mid << 1, mid >> 1, 0});   // weight 0: expanded below, never counted
+        }
+        // Deepen the prefixes until there are plenty of tasks per thread to balance.
+        // The first round always runs so the middle-row task gets split.
+        while (!tasks.empty() &&
+               (tasks[0].col == 1 || (tasks.size() < (size_t)threads * 64 && tasks[0].col < n - 3))) {
+            std::vector<Task> next;
+            for (const Task& t : tasks) {
+                std::uint64_t free = mask & ~(t.rows | t.diag | t.anti);
+                // Middle-row first queen: mirror on the second column instead.
+                if (t.weight == 0) free &= (t.rows & (~t.rows + 1)) - 1;
+                while (free) {
+                    std::uint64_t bit = free & (~free + 1);
+                    free ^= bit;
+                    next.push_back({t.col + 1, t.rows | bit, (t.diag | bit) << 1, (t.anti | bit) >> 1, 2});
+                }
+            }
+            tasks.swap(next);
+        }
+
+        std::vector<WorkerQueue> queues(threads);
+        for (size_t i = 0; i < tasks.size(); ++i) queues[i % threads].tasks.push_back(tasks[i]);
+        std::vector<WorkerCount> counts(threads);
+
+        auto worker = [&](int id) {
+            std::uint64_t local = 0;
+            instr::Tally tally;
+            Task task;
+            while (takeTask(queues, id, task))
+                local += task.weight * countFrom(task.col, task.rows, task.diag, task.anti, tally);
+            tally.flush();
+            counts[id].solutions = local;
+        };
+        std::vector<std::thread> pool;
+        for (int id = 1; id < threads; ++id) pool.emplace_back(worker, id);
+        worker(0);
+        for (auto& t : pool) t.join();
+
+        std::uint64_t total = 0;
+        for (const WorkerCount& c : counts) total += c.solutions;
+        return total;
+    }
+
+    /*
+     * Counts solutions up to the 8 symmetries of the square (rotations and
+     * reflections), and the total as a by-product. Each unique solution is found
+     * once in its canonical orientation. Searches are pruned so that no rotation or
+     * reflection of the partial board could be smaller. The solution is then weighted
+     * by its symmetry class: 2 if it is invariant under 90 degree rotation, 4 under
+     * 180 degrees only, 8 otherwise.
+     */
+    void countUnique(std::uint64_t& unique, std::uint64_t& total) {
+        count2 = count4 = count8 = 0;
+        if (n < 5) {
+            countUniqueSmall(unique, total);
+            return;
+        }
+        last = n - 1;
+        topBit = 1ULL << last;
+
+        // Queen in the corner of column 0: only the 180 degree symmetry can fix it,
+        // and keeping column 1's queen below the diagonal leaves each solution once.
+        board[0] = 1;
+        for (bound1 = 2; bound1 < last; ++bound1) {
+            std::uint64_t bit = 1ULL << bound1;
+            board[1] = bit;
+            cornerSearch(2, 1 | bit, (2 | bit) << 1, bit >> 1);
+        }
+
+        // Queen off the corner: row bound1 in column 0, mirrored by bound2 at the far end.
+        sideMask = lastMask = topBit | 1;
+        endBit = topBit >> 1;
+        for (bound1 = 1, bound2 = n - 2; bound1 < bound2; ++bound1, --bound2) {
+            std::uint64_t bit = 1ULL << bound1;
+            board[0] = bit;
+            innerSearch(1, bit, bit << 1, bit >> 1);
+            lastMask |= lastMask >> 1 | lastMask << 1;
+            endBit >>= 1;
+        }
+
+        unique = count2 + count4 + count8;
+        total = count2 * 2 + count4 * 4 + count8 * 8;
+    }
+
+private:
+    struct Task {
+        int col;
+        std::uint64_t rows, diag, anti;
+        std::uint64_t weight;   // solutions below this prefix count this many times
+    };
+
+    struct alignas(64) WorkerQueue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    struct alignas(64) WorkerCount {
+        std::uint64_t solutions = 0;
+    };
+
+    /*
+     * Own queue first (newest task), then one sweep over the other queues stealing
+     * their oldest task. No task creates new ones, so a sweep that finds nothing
+     * means all work is handed out.
+     */
+    static bool takeTask(std::vector<WorkerQueue>& queues, int id, Task& out) {
+        int count = queues.size();
+        {
+            std::lock_guard<std::mutex> guard(queues[id].lock);
+            if (!queues[id].tasks.empty()) {
+                out = queues[id].tasks.back();
+                queues[id].tasks.pop_back();
+                return true;
+            }
+        }
+        for (int i = 1; i < count; ++i) {
+            WorkerQueue& victim = queues[(id + i) % count];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tasks.empty()) {
+                out = victim.tasks.front();
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int n;
+    std::uint64_t mask;
+    std::vector<std::uint64_t> board;   // board[col] = single bit of the queen's row
+    int last = 0, bound1 = 0, bound2 = 0;
+    std::uint64_t topBit = 0, endBit = 0, sideMask = 0, lastMask = 0;
+    std::uint64_t count2 = 0, count4 = 0, count8 = 0;
+
+    /*
+     * rows: rows already taken. diag / anti: squares of this column attacked along
+     * each diagonal direction; they move one row per column, hence the shifts.
+     * The caller flushes tally.
+     */
+    std::uint64_t countFrom(int col, std::uint64_t rows, std::uint64_t diag, std::uint64_t anti,
+                            instr::Tally& tally) const {
+        if (col == n) return 1;
+        std::uint64_t free = mask & ~(rows | diag | anti);
+        if (col == n - 1) return free ? 1 : 0;     // at most one row is left in the last column
+        tally.add(instr::NODES_EXPANDED);
+        tally.add(instr::NODES_GENERATED, __builtin_popcountll(free));
+        if (!free) tally.add(instr::PRUNED);
+        std::uint64_t count = 0;
+        while (free) {
+            std::uint64_t bit = free & (~free + 1);
+            free ^= bit;
+            count += countFrom(col + 1, rows | bit, (diag | bit) << 1, (anti | bit) >> 1, tally);
+        }
+        return count;
+    }
+
+    void enumerateFrom(int col, std::uint64_t taken, std::uint64_t diag, std::uint64_t anti,
+                       std::vector<int>& rows, SolutionSink& sink) const {
+        if (col == n) {
+            sink.accept(rows);
+            return;
+        }
+        std::uint64_t free = mask & ~(taken | diag | anti);
+        while (free) {
+            std::uint64_t bit = free & (~free + 1);
+            free ^= bit;
+            rows[col] = __builtin_ctzll(bit);
+            enumerateFrom(col + 1, taken | bit, (diag | bit) << 1, (anti | bit) >> 1, rows, sink);
+        }
+    }
+
+    void cornerSearch(int col, std::uint64_t rows, std::uint64_t diag, std::uint64_t anti) {
+        std::uint64_t free = mask & ~(rows | diag | anti);
+        if (col == last) {
+            if (free) {
+                board[col] = free;
+                ++count8;
+            }
+            return;
+        }
+        if (col < bound1) free &= ~2ULL;
+        while (free) {
+            std::uint64_t bit = free & (~free + 1);
+            free ^= bit;
+            board[col] = bit;
+            cornerSearch(col + 1, rows | bit, (diag | bit) << 1, (anti | bit) >> 1);
+        }
+    }
+
+    void innerSearch(int col, std::uint64_t rows, std::uint64_t diag, std::uint64_t anti) {
+        std::uint64_t free = mask & ~(rows | diag | anti);
+        if (col == last) {
+            if (free && !(free & lastMask)) {
+                board[col] = free;
+                classify();
+            }
+            return;
+        }
+        if (col < bound1) {
+            free &= ~sideMask;
+        } else if (col == bound2) {
+            if (!(rows & sideMask)) return;
+            if ((rows & sideMask) != sideMask) free &= sideMask;
+        }
+        while (free) {
+            std::uint64_t bit = free & (~free + 1);
+            free ^= bit;
+            board[col] = bit;
+            innerSearch(col + 1, rows | bit, (diag | bit) << 1, (anti | bit) >> 1);
+        }
+    }
+
+    /*
+     * Compares the finished board with its 90, 180 and 270 degree rotations. A
+     * rotation that is smaller means this is not the canonical copy, so it is
+     * dropped. An equal rotation fixes the symmetry class.
+     */
+    void classify() {
+        const std::uint64_t* b = board.data();
+        const std::uint64_t* end = b + last;
+        const std::uint64_t* own;
+        const std::uint64_t* you;
+        std::uint64_t bit, ptn;
+
+        if (b[bound2] == 1) {   // 90 degrees
+            for (ptn = 2, own = b + 1; own <= end; ++own, ptn <<= 1) {
+                bit = 1;
+                for (you = end; *you != ptn && *own >= bit; --you) bit <<= 1;
+                if (*own > bit) return;
+                if (*own < bit) break;
+            }
+            if (own > end) {
+                ++count2;
+                return;
+            }
+        }
+        if (*end == endBit) {   // 180 degrees
+            for (you = end - 1, own = b + 1; own <= end; ++own, --you) {
+                bit = 1;
+                for (ptn = topBit; ptn != *you && *own >= bit; ptn >>= 1) bit <<= 1;
+                if (*own > bit) return;
+                if (*own < bit) break;
+            }
+            if (own > end) {
+                ++count4;
+                return;
+            }
+        }
+        if (b[bound1] == topBit) {  // 270 degrees
+            for (ptn = topBit >> 1, own = b + 1; own <= end; ++own, ptn >>= 1) {
+                bit = 1;
+                for (you = b; *you != ptn && *own >= bit; ++you) bit <<= 1;
+                if (*own > bit) return;
+                if (*own < bit) break;
+            }
+        }
+        ++count8;
+    }
+
+    /*
+     * The symmetry pruning above needs N >= 5. Below that there are at most two
+     * solutions, so each one is simply compared against its 8 images.
+     */
+    void countUniqueSmall(std::uint64_t& unique, std::uint64_t& total) {
+        unique = total = 0;
+        std::vector<int> rows(n);
+        enumerateSmall(0, rows, unique, total);
+    }
+
+    void enumerateSmall(int col, std::vector<int>& rows, std::uint64_t& unique, std::uint64_t& total) {
+        if (col == n) {
+            ++total;
+            // Canonical if no symmetric image is lexicographically smaller.
+            for (int s = 1; s < 8; ++s) {
+                std::vector<int> image(n);
+                for (int c = 0; c < n; ++c) {
+                    int r = rows[c], x = c, y = r;
+                    if (s & 1) x = n - 1 - x;
+                    if (s & 2) y = n - 1 - y;
+                    if (s & 4) std::swap(x, y);
+                    image[x] = y;
+                }
+                if (image < rows) return;
+            }
+            ++unique;
+            return;
+        }
+        for (int r = 0; r < n; ++r) {
+            if (isSafeIn(rows, r, col)) {
+                rows[col] = r;
+                enumerateSmall(col + 1, rows, unique, total);
+            }
+        }
+    }
+
+    static bool isSafeIn(const std::vector<int>& rows, int row, int col) {
+        for (int i = 0; i < col; ++i)
+            if (rows[i] == row || std::abs(rows[i] - row) == std::abs(i - col)) return false;
+        return true;
+    }
+};
+
+/*
+ * Queens per row, per diagonal and per anti-diagonal, in flat arrays, so whether a
+ * square is attacked is three lookups. The queen in column c and row r sits on
+ * diagonal c - r + n - 1 and anti-diagonal c + r. collisions counts every queen
+ * beyond the first on each line, so a valid board has zero.
+ */
+struct ConflictCounts {
+    int n;
+    std::vector<int> row, diag, anti;
+    long long collisions = 0;
+
+    explicit ConflictCounts(int n) : n(n), row(n, 0), diag(2 * n - 1, 0), anti(2 * n - 1, 0) {}
+
+    void add(int col, int r) {
+        collisions += (row[r]++ > 0) + (diag[col - r + n - 1]++ > 0) + (anti[col + r]++ > 0);
+    }
+
+    void remove(int col, int r) {
+        collisions -= (--row[r] > 0) + (--diag[col - r + n - 1] > 0) + (--anti[col + r] > 0);
+    }
+
+    // Whether a queen already placed at (col, r) shares a line with another queen.
+    bool attacked(int col, int r) const {
+        return row[r] > 1 || diag[col - r + n - 1] > 1 || anti[col + r] > 1;
+    }
+};
+
+/*
+ * Checks a placement (rows[col] = row) by counting it into fresh conflict arrays.
+ */
+bool verifyPlacement(const std::vector<int>& rows) {
+    int n = rows.size();
+    ConflictCounts counts(n);
+    for (int col = 0; col < n; ++col) {
+        if (rows[col] < 0 || rows[col] >= n) return false;
+        counts.add(col, rows[col]);
+    }
+    return counts.collisions == 0;
+}
+
+/*
+ * Finds one solution for very large N by local search instead of backtracking.
+ * Queens always form a permutation (one per row and column), so only diagonals can
+ * clash. The start is greedy: each column takes a random unused row whose diagonals
+ * are still free, which leaves only a handful of conflicts. Repair then swaps the
+ * rows of an attacked queen and a random other queen whenever that lowers the
+ * number of collisions. Memory is four int arrays of about N to 2N entries.
+ */
+class MinConflictsSolver {
+public:
+    explicit MinConflictsSolver(int n, std::uint64_t seed = 1) : n(n), rows(n), counts(n), rng(seed) {}
+
+    /*
+     * Returns true once a valid placement is found. Gives up after maxSwaps
+     * attempted swaps across all restarts.
+     */
+    bool solve(long long maxSwaps) {
+        if (n == 2 || n == 3) return false;
+        // Partners tried per attacked queen; few on small boards so stalls restart quickly.
+        int tries = std::min(1024, 4 * n);
+        while (maxSwaps > 0) {
+            greedyStart();
+            while (counts.collisions > 0 && maxSwaps > 0) {
+                for (int col = 0; col < n && counts.collisions > 0; ++col) {
+                    if (!counts.attacked(col, rows[col])) continue;
+                    INSTR_COUNT(NODES_EXPANDED);
+                    for (int attempt = 0; attempt < tries && maxSwaps > 0; ++attempt, --maxSwaps) {
+                        if (trySwap(col, rng() % n)) break;
+                    }
+                }
+                // Small boards can stall in a local minimum; start over instead of looping.
+                if (++passes % 64 == 0 && counts.collisions > 0) break;
+            }
+            if (counts.collisions == 0) return true;
+        }
+        return false;
+    }
+
+    const std::vector<int>& solution() const { return rows; }
+    long long swapsMade() const { return swaps; }
+    long long initialCollisions() const { return startCollisions; }
+
+private:
+    int n;
+    std::vector<int> rows;      // rows[col] = row of the queen in that column
+    ConflictCounts counts;
+    std::mt19937_64 rng;
+    long long swaps = 0, passes = 0, startCollisions = 0;
+
+    void greedyStart() {
+        counts = ConflictCounts(n);
+        for (int col = 0; col < n; ++col) rows[col] = col;
+        for (int col = 0; col < n; ++col) {
+            // rows[col..n) are the rows still unused; try a few for free diagonals.
+            int pick = col + rng() % (n - col);
+            for (int attempt = 0; attempt < 32; ++attempt) {
+                int r = rows[pick];
+                if (counts.diag[col - r + n - 1] == 0 && counts.anti[col + r] == 0) break;
+                pick = col + rng() % (n - col);
+            }
+            std::swap(rows[col], rows[pick]);
+            counts.add(col, rows[col]);
+        }
+        startCollisions = counts.collisions;
+    }
+
+    // Exchanges the rows of columns a and b if that lowers the collision count.
+    bool trySwap(int a, int b) {
+        if (a == b) return false;
+        INSTR_COUNT(NODES_GENERATED);
+        long long before = counts.collisions;
+        counts.remove(a, rows[a]);
+        counts.remove(b, rows[b]);
+        counts.add(a, rows[b]);
+        counts.add(b, rows[a]);
+        if (counts.collisions < before) {
+            std::swap(rows[a], rows[b]);
+            ++swaps;
+            return true;
+        }
+        INSTR_COUNT(BACKTRACKS);
+        counts.remove(a, rows[b]);
+        counts.remove(b, rows[a]);
+        counts.add(a, rows[a]);
+        counts.add(b, rows[b]);
+        return false;
+    }
+};
+
+/*
+ * Runs countAllParallel with 1, 2, 4, ... up to the hardware thread count and
+ * reports solutions per second and the speedup over one thread.
+ */
+void parallelScaling(int n) {
+    int hw = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> counts;
+    for (int t = 1; t < hw; t *= 2) counts.push_back(t);
+    counts.push_back(hw);
+
+    std::cout << "N = " << n << "\n";
+    std::cout << "Threads |      Solutions |   Time (s) |  Solutions/s | Speedup\n";
+    double baseSeconds = 0;
+    for (int t : counts) {
+        NQueensCounter counter(n);
+        auto start = std::chrono::steady_clock::now();
+        std::uint64_t total = t == 1 ? counter.countAll() : counter.countAllParallel(t);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (t == 1) baseSeconds = seconds;
+        std::cout << std::setw(7) << t << " | " << std::setw(14) << total << " | " << std::fixed
+                  << std::setprecision(3) << std::setw(10) << seconds << " | " << std::setw(12)
+                  << (std::uint64_t)(total / seconds) << " | " << std::setprecision(2) << baseSeconds / seconds
+                  << "x\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    // One JSON line per solver in the schema of instrumentation.h: "--json [n]".
+    // Build with -DINSTRUMENTATION=1 for the work counters.
+    if (argc >= 2 && std::string(argv[1]) == "--json") {
+        int n = argc >= 3 ? std::atoi(argv[2]) : 10;
+        if (n < 4 || n > 63) {
+            std::cout << "N must be between 4 and 63.\n";
+            return 1;
+        }
+        {
+            std::vector<int> board(n);
+            CountingSink sink;
+            instr::Run run("backtracking isSafe", "N = " + std::to_string(n));
+            solveNQueens(board, 0, sink);
+            run.extra("solutions", sink.count());
+            std::cout << run.finish() << "\n";
+        }
+        {
+            instr::Run run("bitmask counter", "N = " + std::to_string(n));
+            run.extra("solutions", NQueensCounter(n).countAll());
+            std::cout << run.finish() << "\n";
+        }
+        {
+            int big = 1000 * n;
+            MinConflictsSolver solver(big);
+            instr::Run run("min-conflicts", "N = " + std::to_string(big));
+            bool solved = solver.solve(100LL * big + 1000000);
+            run.extra("solved", solved).extra("swaps", solver.swapsMade());
+            std::cout << run.finish() << "\n";
+        }
+        return 0;
+    }
+    if (argc >= 3 && std::string(argv[1]) == "--parallel") {
+        int n = std::atoi(argv[2]);
+        if (n < 1 || n > 63) {
+            std::cout << "N must be between 1 and 63.\n";
+            return 1;
+        }
+        parallelScaling(n);
+        return 0;
+    }
+    // One solution for huge N by local search: "--min-conflicts 1000000 [seed]".
+    if (argc >= 3 && std::string(argv[1]) == "--min-conflicts") {
+        int n = std::atoi(argv[2]);
+        if (n < 1) {
+            std::cout << "N must be positive.\n";
+            return 1;
+        }
+        std::uint64_t seed = argc >= 4 ? std::strtoull(argv[3], nullptr, 10) : 1;
+        MinConflictsSolver solver(n, seed);
+        auto start = std::chrono::steady_clock::now();
+        bool solved = solver.solve(100LL * n + 1000000);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (!solved) {
+            std::cout << "N = " << n << ": no solution found (" << seconds << " s)\n";
+            return 1;
+        }
+        auto verifyStart = std::chrono::steady_clock::now();
+        bool valid = verifyPlacement(solver.solution());
+        double verifySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - verifyStart).count();
+        std::cout << "N = " << n << ": solved in " << seconds << " s, " << solver.initialCollisions()
+                  << " collisions after the last greedy start, " << solver.swapsMade() << " repair swaps in total\n";
+        std::cout << "Verified: " << (valid ? "valid" : "INVALID") << " (" << verifySeconds << " s)\n";
+        if (n <= 20) printSolution(solver.solution(), 1);
+        return valid ? 0 : 1;
+    }
+
+    // Writes every solution to a binary file: "--dump 12 out.bin [--compress]".
+    if (argc >= 4 && std::string(argv[1]) == "--dump") {
+        int n = std::atoi(argv[2]);
+        if (n < 1 || n > 63) {
+            std::cout << "N must be between 1 and 63.\n";
+            return 1;
+        }
+        bool compress = argc >= 5 && std::string(argv[4]) == "--compress";
+        std::ofstream out(argv[3], std::ios::binary);
+        auto start = std::chrono::steady_clock::now();
+        BinaryStreamSink sink(out, n, compress);
+        NQueensCounter(n).enumerate(sink);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "N = " << n << ": wrote " << sink.count() << " solutions, " << sink.bytesWritten()
+                  << " bytes to " << argv[3] << " (" << seconds << " s)\n";
+
+        // enumerate yields the solutions in increasing lexicographic order, so distinct
+        // valid boards in that order, as many as were written, are exactly the solutions.
+        out.close();
+        std::ifstream in(argv[3], std::ios::binary);
+        std::vector<int> previous;
+        long long bad = 0;
+        long long readBack = readSolutionStream(in, [&](const std::vector<int>& board) {
+            bool valid = (int)board.size() == n && (previous.empty() || previous < board);
+            for (int col = 0; col < n && valid; ++col)
+                valid = board[col] >= 0 && board[col] < n && isSafe(board, board[col], col);
+            bad += !valid;
+            previous = board;
+        });
+        std::cout << "Read back " << readBack << " solutions, " << bad << " invalid or out of order.\n";
+        return readBack == (long long)sink.count() && bad == 0 ? 0 : 1;
+    }
+
+    // Counting modes for any N: "--count 16" for all solutions, "--unique 16" to
+    // also count them up to rotation and reflection.
+    if (argc >= 3 && (std::string(argv[1]) == "--count" || std::string(argv[1]) == "--unique")) {
+        int n = std::atoi(argv[2]);
+        if (n < 1 || n > 63) {
+            std::cout << "N must be between 1 and 63.\n";
+            return 1;
+        }
+        NQueensCounter counter(n);
+        auto start = std::chrono::steady_clock::now();
+        std::uint64_t unique = 0, total;
+        bool wantUnique = std::string(argv[1]) == "--unique";
+        if (wantUnique) {
+            counter.countUnique(unique, total);
+        } else {
+            total = counter.countAll();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "N = " << n << ": " << total << " solutions";
+        if (wantUnique) std::cout << ", " << unique << " unique up to symmetry";
+        std::cout << " (" << seconds << " s)\n";
+        return 0;
+    }
+
     // The 'board' vector stores the row number for each queen.
     // The index of the vector represents the column number.
     // For example, board[3] = 5 means a queen is at column 3, row 5.
@@ -93,12 +905,13 @@ int main() {
     std::cout << "Finding all solutions for the 8-Queens problem...\n\n";
     
     // Start the recursive search from the first column (column 0)
-    solveNQueens(board, 0);
+    PrintingSink sink;
+    solveNQueens(board, 0, sink);
 
-    if (solutionCount == 0) {
+    if (sink.count() == 0) {
         std::cout << "No solution exists.\n";
     } else {
-        std::cout << "Found a total of " << solutionCount << " solutions.\n";
+        std::cout << "Found a total of " << sink.count() << " solutions.\n";
     }
 
     return 0;
@@ -1,4 +1,6 @@
 #include <bits/stdc++.h>
+#include "../common/instrumentation.h"
+#include "../common/knowledge_base.h"
 using namespace std;
 
 // A rule: antecedents -> consequent
@@ -62,7 +64,1040 @@ bool forward_chaining(const unordered_set<string>& initial_facts,
     return (known.find(query) != known.end());
 }
 
-int main() {
+// ---------------------------------------------------------------------------
+// Interned knowledge base
+// ---------------------------------------------------------------------------
+// Proposition names are mapped to dense integer ids once, when the rules are
+// loaded, so inference never copies or hashes a string. The symbol table, the
+// CSR rule index and the KB file loaders live in common/knowledge_base.h.
+
+CompiledKB compile_rules(const vector<Rule>& rules) {
+    CompiledKB kb;
+    vector<int> rule_start{0}, antecedents, consequent;
+    for (const auto& r : rules) {
+        for (const auto& a : r.antecedents) antecedents.push_back(kb.symbols.intern(a));
+        rule_start.push_back((int)antecedents.size());
+        consequent.push_back(kb.symbols.intern(r.consequent));
+    }
+    kb.rule_start = Array<int>(move(rule_start));
+    kb.antecedents = Array<int>(move(antecedents));
+    kb.consequent = Array<int>(move(consequent));
+    kb.build_index();
+    return kb;
+}
+
+// forward_chaining over ids. known receives the facts derived so far; like the string
+// version it stops as soon as query is derived (pass -1 to compute the whole closure).
+bool forward_chaining_ids(const CompiledKB& kb, const vector<int>& initial_facts, int query, FactSet& known) {
+    vector<int> count(kb.num_rules());
+    for (int r = 0; r < kb.num_rules(); ++r) count[r] = kb.rule_start[r + 1] - kb.rule_start[r];
+
+    known = FactSet(kb.num_props());
+    vector<int> agenda;
+    agenda.reserve(kb.num_props());
+    for (int f : initial_facts)
+        if (known.insert(f)) agenda.push_back(f);
+
+    // The agenda is a plain array read front to back: every fact enters it once.
+    instr::Tally tally;
+    for (size_t head = 0; head < agenda.size(); ++head) {
+        int p = agenda[head];
+        tally.add(instr::NODES_EXPANDED);
+        for (int i = kb.prop_start[p]; i < kb.prop_start[p + 1]; ++i) {
+            int r = kb.prop_rules[i];
+            if (count[r] > 0 && --count[r] == 0) {
+                tally.add(instr::RULES_FIRED);
+                int c = kb.consequent[r];
+                if (known.insert(c)) {
+                    tally.add(instr::FACTS_DERIVED);
+                    agenda.push_back(c);
+                    if (c == query) {
+                        tally.flush();
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+    tally.flush();
+    return query >= 0 && known.test(query);
+}
+
+// Makes every thread wait until all of them have arrived, then lets them all go.
+class RoundBarrier {
+public:
+    explicit RoundBarrier(int total) : total(total) {}
+
+    void arrive_and_wait() {
+        unique_lock<mutex> lock(m);
+        long my_round = round;
+        if (++waiting == total) {
+            waiting = 0;
+            ++round;
+            cv.notify_all();
+        } else {
+            cv.wait(lock, [&] { return round != my_round; });
+        }
+    }
+
+private:
+    mutex m;
+    condition_variable cv;
+    int total, waiting = 0;
+    long round = 0;
+};
+
+// forward_chaining_ids with the agenda processed a frontier at a time. Each round the
+// facts derived in the previous round are handed out in chunks to num_threads threads
+// (0 = hardware concurrency); rule counters are decremented atomically and facts are
+// claimed with an atomic or on their word of the bit set, so every fact is derived
+// exactly once. The closure is the same as the serial one; only the order differs.
+bool forward_chaining_parallel(const CompiledKB& kb, const vector<int>& initial_facts, int query, FactSet& known,
+                               int num_threads = 0) {
+    if (num_threads <= 0) num_threads = max(1u, thread::hardware_concurrency());
+    vector<atomic<int>> count(kb.num_rules());
+    for (int r = 0; r < kb.num_rules(); ++r) count[r].store(kb.rule_start[r + 1] - kb.rule_start[r], memory_order_relaxed);
+
+    known = FactSet(kb.num_props());
+    vector<int> frontier;
+    for (int f : initial_facts)
+        if (known.insert(f)) frontier.push_back(f);
+
+    const size_t CHUNK = 256;
+    atomic<size_t> next_chunk{0};
+    vector<vector<int>> derived(num_threads);
+    bool done = frontier.empty() || (query >= 0 && known.test(query));
+    RoundBarrier barrier(num_threads);
+
+    auto worker = [&](int id) {
+        vector<int>& out = derived[id];
+        instr::Tally tally;
+        while (!done) {
+            size_t begin;
+            while ((begin = next_chunk.fetch_add(CHUNK, memory_order_relaxed)) < frontier.size()) {
+                size_t end = min(frontier.size(), begin + CHUNK);
+                for (size_t k = begin; k < end; ++k) {
+                    int p = frontier[k];
+                    tally.add(instr::NODES_EXPANDED);
+                    for (int i = kb.prop_start[p]; i < kb.prop_start[p + 1]; ++i) {
+                        int r = kb.prop_rules[i];
+                        if (count[r].fetch_sub(1, memory_order_relaxed) != 1) continue;
+                        tally.add(instr::RULES_FIRED);
+                        int c = kb.consequent[r];
+                        uint64_t bit = 1ULL << (c & 63);
+                        if (__atomic_load_n(&known.words[c >> 6], __ATOMIC_RELAXED) & bit) continue;
+                        if (!(__atomic_fetch_or(&known.words[c >> 6], bit, __ATOMIC_RELAXED) & bit)) {
+                            tally.add(instr::FACTS_DERIVED);
+                            out.push_back(c);
+                        }
+                    }
+                }
+            }
+            barrier.arrive_and_wait();
+            // Thread 0 gathers the next frontier while the others wait.
+            if (id == 0) {
+                frontier.clear();
+                for (auto& d : derived) {
+                    frontier.insert(frontier.end(), d.begin(), d.end());
+                    d.clear();
+                }
+                next_chunk.store(0, memory_order_relaxed);
+                done = frontier.empty() || (query >= 0 && known.test(query));
+            }
+            barrier.arrive_and_wait();
+        }
+        tally.flush();
+    };
+
+    vector<thread> pool;
+    for (int t = 1; t < num_threads; ++t) pool.emplace_back(worker, t);
+    worker(0);
+    for (auto& t : pool) t.join();
+    return query >= 0 && known.test(query);
+}
+
+// Forward chaining that keeps its state between calls. The rule counters and the
+// closure live as long as the engine, so asserting a fact only propagates that
+// fact's consequences and a query is one bit test. The KB must be complete (all
+// symbols added) before the engine is built. Rules without antecedents hold from the start.
+class ForwardEngine {
+public:
+    explicit ForwardEngine(const CompiledKB& kb)
+        : kb(kb), known(kb.num_props()), base(kb.num_props()), count(kb.num_rules()) {
+        agenda.reserve(kb.num_props());
+        for (int r = 0; r < kb.num_rules(); ++r) {
+            count[r] = kb.rule_start[r + 1] - kb.rule_start[r];
+            if (count[r] == 0 && known.insert(kb.consequent[r])) agenda.push_back(kb.consequent[r]);
+        }
+        propagate();
+    }
+
+    // Adds p as a told fact. Returns false if p was already told.
+    bool assert_fact(int p) {
+        if (!base.insert(p)) return false;
+        if (known.insert(p)) {
+            agenda.push_back(p);
+            propagate();
+        }
+        return true;
+    }
+
+    bool holds(int p) const { return known.test(p); }
+    bool is_told(int p) const { return base.test(p); }
+    int closure_size() const { return known.count(); }
+
+    // Everything needed to put the engine back where it was.
+    struct Snapshot {
+        FactSet known, base;
+        vector<int> count;
+    };
+
+    Snapshot snapshot() const { return {known, base, count}; }
+
+    void restore(const Snapshot& s) {
+        known = s.known;
+        base = s.base;
+        count = s.count;
+    }
+
+    // Withdraws a told fact and everything that no longer follows without it
+    // (delete and re-derive): first remove every derived fact whose support may go
+    // through p, then re-derive those that still have a rule with all antecedents
+    // known. Returns false if p was not told.
+    bool retract(int p) {
+        if (!base.test(p)) return false;
+        base.erase(p);
+
+        vector<int> removed, stack{p};
+        known.erase(p);
+        while (!stack.empty()) {
+            int q = stack.back();
+            stack.pop_back();
+            removed.push_back(q);
+            for (int i = kb.prop_start[q]; i < kb.prop_start[q + 1]; ++i) {
+                int r = kb.prop_rules[i];
+                // The rule was satisfied before q went, so its consequent may lose its support.
+                if (count[r]++ == 0) {
+                    int c = kb.consequent[r];
+                    if (known.test(c) && !base.test(c)) {
+                        known.erase(c);
+                        stack.push_back(c);
+                    }
+                }
+            }
+        }
+
+        for (int q : removed)
+            if (!known.test(q) && has_satisfied_rule(q) && known.insert(q)) agenda.push_back(q);
+        propagate();
+        return true;
+    }
+
+private:
+    const CompiledKB& kb;
+    FactSet known, base;    // closure, and the facts that were told rather than derived
+    vector<int> count;      // count[r] = antecedents of rule r not yet known
+    vector<int> agenda;
+
+    bool has_satisfied_rule(int q) const {
+        for (int i = kb.conclusion_start[q]; i < kb.conclusion_start[q + 1]; ++i)
+            if (count[kb.conclusion_rules[i]] == 0) return true;
+        return false;
+    }
+
+    void propagate() {
+        instr::Tally tally;
+        for (size_t head = 0; head < agenda.size(); ++head) {
+            int p = agenda[head];
+            tally.add(instr::NODES_EXPANDED);
+            for (int i = kb.prop_start[p]; i < kb.prop_start[p + 1]; ++i) {
+                int r = kb.prop_rules[i];
+                if (--count[r] == 0) {
+                    tally.add(instr::RULES_FIRED);
+                    int c = kb.consequent[r];
+                    if (known.insert(c)) {
+                        tally.add(instr::FACTS_DERIVED);
+                        agenda.push_back(c);
+                    }
+                }
+            }
+        }
+        tally.flush();
+        agenda.clear();
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Rules with variables
+// ---------------------------------------------------------------------------
+// Atoms look like parent(X,Y): names starting with an upper-case letter or '_' are
+// variables, anything else is a constant, and a bare name is an atom with no
+// arguments (so ground rules still work). Predicates and constants share one
+// symbol table.
+
+// args[i] >= 0 is a constant id; args[i] < 0 is variable -1 - args[i] of the rule.
+struct Atom {
+    int pred;
+    vector<int> args;
+};
+
+struct VarRule {
+    vector<Atom> body;
+    Atom head;
+    int num_vars = 0;
+};
+
+bool parse_atom(string_view text, SymbolTable& symbols, unordered_map<string, int>* vars, Atom& atom) {
+    auto trim = [](string_view s) {
+        while (!s.empty() && isspace((unsigned char)s.front())) s.remove_prefix(1);
+        while (!s.empty() && isspace((unsigned char)s.back())) s.remove_suffix(1);
+        return s;
+    };
+    text = trim(text);
+    size_t open = text.find('(');
+    atom.args.clear();
+    atom.pred = symbols.intern(trim(text.substr(0, open)));
+    if (open == string_view::npos) return !text.empty();
+    if (text.back() != ')') return false;
+    string_view rest = text.substr(open + 1, text.size() - open - 2);
+    for (;;) {
+        size_t comma = rest.find(',');
+        string_view arg = trim(rest.substr(0, comma));
+        if (arg.empty()) return false;
+        if (isupper((unsigned char)arg[0]) || arg[0] == '_') {
+            if (!vars) return false;   // facts must be ground
+            auto it = vars->emplace(string(arg), (int)vars->size()).first;
+            atom.args.push_back(-1 - it->second);
+        } else {
+            atom.args.push_back(symbols.intern(arg));
+        }
+        if (comma == string_view::npos) return true;
+        rest.remove_prefix(comma + 1);
+    }
+}
+
+// "parent(X,Y) & parent(Y,Z) -> grandparent(X,Z)". Every variable of the head must
+// occur in the body.
+bool parse_var_rule(const string& text, SymbolTable& symbols, VarRule& rule) {
+    size_t arrow = text.find("->");
+    if (arrow == string::npos) return false;
+    unordered_map<string, int> vars;
+    rule.body.clear();
+    string_view body = string_view(text).substr(0, arrow);
+    for (;;) {
+        size_t amp = body.find('&');
+        Atom atom;
+        if (!parse_atom(body.substr(0, amp), symbols, &vars, atom)) return false;
+        rule.body.push_back(move(atom));
+        if (amp == string_view::npos) break;
+        body.remove_prefix(amp + 1);
+    }
+    int body_vars = (int)vars.size();
+    if (!parse_atom(string_view(text).substr(arrow + 2), symbols, &vars, rule.head)) return false;
+    rule.num_vars = (int)vars.size();
+    return rule.num_vars == body_vars;
+}
+
+// Ground atoms, each stored once, with ids in the order they were added.
+class AtomStore {
+public:
+    // Returns the id of the atom and whether it was new.
+    pair<int, bool> insert(int pred, const int* args, int arity) {
+        vector<int>& bucket = buckets[hash_of(pred, args, arity)];
+        for (int id : bucket)
+            if (equals(id, pred, args, arity)) return {id, false};
+        int id = size();
+        bucket.push_back(id);
+        preds.push_back(pred);
+        arg_values.insert(arg_values.end(), args, args + arity);
+        arg_start.push_back((int)arg_values.size());
+        return {id, true};
+    }
+
+    int find(int pred, const vector<int>& args) const {
+        auto it = buckets.find(hash_of(pred, args.data(), (int)args.size()));
+        if (it != buckets.end())
+            for (int id : it->second)
+                if (equals(id, pred, args.data(), (int)args.size())) return id;
+        return -1;
+    }
+
+    int size() const { return (int)preds.size(); }
+    int pred(int id) const { return preds[id]; }
+    int arity(int id) const { return arg_start[id + 1] - arg_start[id]; }
+    const int* args(int id) const { return arg_values.data() + arg_start[id]; }
+
+    string text(int id, const SymbolTable& symbols) const {
+        string s(symbols.name(preds[id]));
+        for (int i = 0; i < arity(id); ++i) (s += i ? "," : "(") += symbols.name(args(id)[i]);
+        return arity(id) ? s + ")" : s;
+    }
+
+private:
+    vector<int> preds, arg_start{0}, arg_values;
+    unordered_map<uint64_t, vector<int>> buckets;
+
+    static uint64_t hash_of(int pred, const int* args, int arity) {
+        uint64_t h = (uint64_t)pred * 0x9E3779B97F4A7C15ULL;
+        for (int i = 0; i < arity; ++i) h = (h ^ (uint32_t)args[i]) * 0x100000001B3ULL + (h >> 29);
+        return h;
+    }
+
+    bool equals(int id, int pred, const int* values, int arity) const {
+        return preds[id] == pred && this->arity(id) == arity && equal(values, values + arity, args(id));
+    }
+};
+
+// Forward chaining for rules with variables, with the rules matched by a Rete
+// network. Each body atom has an alpha memory (facts of its predicate that pass its
+// constant tests; atoms with the same tests share one), and each rule is a chain of
+// join nodes whose beta memories hold the partial matches (variable bindings) of its
+// first atoms. Both sides of a join are hash-indexed on the variables the join shares,
+// so a new fact only meets the partial matches it agrees with: the work per fact
+// depends on what it matches, not on how many facts there are. The agenda is the one
+// ForwardEngine uses, with the network in place of the rule counters.
+class ReteEngine {
+public:
+    explicit ReteEngine(const vector<VarRule>& rules) : rules(rules) {
+        for (int r = 0; r < (int)rules.size(); ++r) {
+            RuleNet net;
+            vector<char> bound(rules[r].num_vars, 0);
+            for (int level = 0; level < (int)rules[r].body.size(); ++level) {
+                const Atom& atom = rules[r].body[level];
+                JoinNode join;
+                join.alpha = alpha_for(atom);
+                for (int i = 0; i < (int)atom.args.size(); ++i) {
+                    int v = -1 - atom.args[i];
+                    if (atom.args[i] < 0 && bound[v] == 1) {
+                        join.vars.push_back(v);
+                        join.positions.push_back(i);
+                    }
+                }
+                for (int a : atom.args)
+                    if (a < 0) bound[-1 - a] = 1;
+                alphas[join.alpha].successors.push_back({r, level});
+                net.joins.push_back(move(join));
+            }
+            net.beta.resize(rules[r].body.size());
+            nets.push_back(move(net));
+        }
+    }
+
+    // Adds a ground atom and everything that follows from it. Returns false if it was known.
+    bool assert_fact(const Atom& atom) {
+        auto [id, added] = facts.insert(atom.pred, atom.args.data(), (int)atom.args.size());
+        if (!added) return false;
+        agenda.push_back(id);
+        propagate();
+        return true;
+    }
+
+    bool holds(const Atom& atom) const { return facts.find(atom.pred, atom.args) >= 0; }
+    const AtomStore& atoms() const { return facts; }
+    long long activations() const { return joins_tried; }
+
+private:
+    struct Alpha {
+        int pred, arity;
+        vector<pair<int, int>> constants;   // (argument position, constant)
+        vector<pair<int, int>> successors;  // (rule, body position) fed by this memory
+    };
+
+    struct JoinNode {
+        int alpha;
+        vector<int> vars, positions;        // variables shared with earlier atoms, and where they occur
+        unordered_map<uint64_t, vector<int>> right;     // facts of the alpha memory by join key
+    };
+
+    struct BetaMemory {
+        vector<int> bindings;               // num_vars values per partial match
+        int size = 0;
+        unordered_map<uint64_t, vector<int>> by_key;    // partial matches by the next join's key
+    };
+
+    struct RuleNet {
+        vector<JoinNode> joins;             // one per body atom; joins[0] has no left input
+        vector<BetaMemory> beta;            // beta[level]: matches of body atoms 0..level
+    };
+
+    const vector<VarRule>& rules;
+    vector<Alpha> alphas;
+    unordered_map<int, vector<int>> alphas_of_pred;
+    map<tuple<int, int, vector<pair<int, int>>>, int> alpha_ids;
+    vector<RuleNet> nets;
+    AtomStore facts;
+    vector<int> agenda;
+    long long joins_tried = 0;
+
+    int alpha_for(const Atom& atom) {
+        vector<pair<int, int>> constants;
+        for (int i = 0; i < (int)atom.args.size(); ++i)
+            if (atom.args[i] >= 0) constants.push_back({i, atom.args[i]});
+        auto key = make_tuple(atom.pred, (int)atom.args.size(), constants);
+        auto it = alpha_ids.find(key);
+        if (it != alpha_ids.end()) return it->second;
+        alphas.push_back({atom.pred, (int)atom.args.size(), constants, {}});
+        alphas_of_pred[atom.pred].push_back((int)alphas.size() - 1);
+        return alpha_ids[key] = (int)alphas.size() - 1;
+    }
+
+    static uint64_t mix(uint64_t h, int value) { return (h ^ (uint32_t)value) * 0x100000001B3ULL + (h >> 29); }
+
+    static uint64_t left_key(const JoinNode& join, const int* binding) {
+        uint64_t h = 0;
+        for (int v : join.vars) h = mix(h, binding[v]);
+        return h;
+    }
+
+    static uint64_t right_key(const JoinNode& join, const int* args) {
+        uint64_t h = 0;
+        for (int p : join.positions) h = mix(h, args[p]);
+        return h;
+    }
+
+    // Binds the atom's variables against the fact; false if they disagree with the binding.
+    bool extend(const Atom& atom, int fact, vector<int>& binding) const {
+        const int* args = facts.args(fact);
+        for (int i = 0; i < (int)atom.args.size(); ++i) {
+            if (atom.args[i] >= 0) continue;
+            int& slot = binding[-1 - atom.args[i]];
+            if (slot < 0) slot = args[i];
+            else if (slot != args[i]) return false;
+        }
+        return true;
+    }
+
+    // A fact entered the alpha memory feeding body atom `level` of rule r.
+    void right_activate(int r, int level, int fact) {
+        RuleNet& net = nets[r];
+        JoinNode& join = net.joins[level];
+        const Atom& atom = rules[r].body[level];
+        int n = rules[r].num_vars;
+        vector<int> binding(n);
+        if (level == 0) {
+            fill(binding.begin(), binding.end(), -1);
+            if (extend(atom, fact, binding)) left_activate(r, 0, binding);
+            return;
+        }
+        uint64_t key = right_key(join, facts.args(fact));
+        join.right[key].push_back(fact);
+        INSTR_COUNT(TABLE_PROBES);
+        auto it = net.beta[level - 1].by_key.find(key);
+        if (it == net.beta[level - 1].by_key.end()) return;
+        INSTR_COUNT(TABLE_HITS);
+        for (size_t k = 0; k < it->second.size(); ++k) {
+            const int* stored = &net.beta[level - 1].bindings[(size_t)it->second[k] * n];
+            binding.assign(stored, stored + n);
+            ++joins_tried;
+            if (extend(atom, fact, binding)) left_activate(r, level, binding);
+        }
+    }
+
+    // binding matches body atoms 0..level of rule r.
+    void left_activate(int r, int level, const vector<int>& binding) {
+        const VarRule& rule = rules[r];
+        if (level + 1 == (int)rule.body.size()) {
+            vector<int> args;
+            for (int a : rule.head.args) args.push_back(a >= 0 ? a : binding[-1 - a]);
+            auto [id, added] = facts.insert(rule.head.pred, args.data(), (int)args.size());
+            INSTR_COUNT(RULES_FIRED);
+            if (added) {
+                INSTR_COUNT(FACTS_DERIVED);
+                agenda.push_back(id);
+            }
+            return;
+        }
+        RuleNet& net = nets[r];
+        BetaMemory& memory = net.beta[level];
+        JoinNode& next = net.joins[level + 1];
+        uint64_t key = left_key(next, binding.data());
+        memory.by_key[key].push_back(memory.size++);
+        memory.bindings.insert(memory.bindings.end(), binding.begin(), binding.end());
+
+        INSTR_COUNT(TABLE_PROBES);
+        auto it = next.right.find(key);
+        if (it == next.right.end()) return;
+        INSTR_COUNT(TABLE_HITS);
+        vector<int> extended;
+        for (size_t k = 0; k < it->second.size(); ++k) {
+            extended = binding;
+            ++joins_tried;
+            if (extend(rule.body[level + 1], it->second[k], extended)) left_activate(r, level + 1, extended);
+        }
+    }
+
+    bool passes(const Alpha& alpha, int fact) const {
+        if (facts.arity(fact) != alpha.arity) return false;
+        for (auto [pos, value] : alpha.constants)
+            if (facts.args(fact)[pos] != value) return false;
+        return true;
+    }
+
+    void propagate() {
+        for (size_t head = 0; head < agenda.size(); ++head) {
+            int fact = agenda[head];
+            INSTR_COUNT(NODES_EXPANDED);
+            auto it = alphas_of_pred.find(facts.pred(fact));
+            if (it == alphas_of_pred.end()) continue;
+            for (int a : it->second)
+                if (passes(alphas[a], fact))
+                    for (auto [r, level] : alphas[a].successors) right_activate(r, level, fact);
+        }
+        agenda.clear();
+    }
+};
+
+// Random KB of num_rules rules over num_props propositions named P0, P1, ...
+// Each rule has 1..max_antecedents antecedents; the first num_facts propositions are facts.
+void make_synthetic_kb(int num_rules, int num_props, int max_antecedents, int num_facts, unsigned seed,
+                       vector<Rule>& rules, unordered_set<string>& facts) {
+    mt19937 rng(seed);
+    rules.clear();
+    rules.reserve(num_rules);
+    for (int r = 0; r < num_rules; ++r) {
+        Rule rule;
+        int k = 1 + rng() % max_antecedents;
+        for (int i = 0; i < k; ++i) rule.antecedents.push_back("P" + to_string(rng() % num_props));
+        rule.consequent = "P" + to_string(rng() % num_props);
+        rules.push_back(move(rule));
+    }
+    facts.clear();
+    for (int f = 0; f < num_facts; ++f) facts.insert("P" + to_string(f));
+}
+
+// Whole closure of a synthetic KB with the string version and with the interned
+// version, checking both derive the same facts.
+void benchmark_interned(int num_rules) {
+    vector<Rule> rules;
+    unordered_set<string> facts;
+    make_synthetic_kb(num_rules, num_rules / 4, 3, num_rules / 200, 7, rules, facts);
+
+    auto t0 = chrono::steady_clock::now();
+    unordered_set<string> derived;
+    forward_chaining(facts, rules, "", derived);
+    auto t1 = chrono::steady_clock::now();
+    CompiledKB kb = compile_rules(rules);
+    vector<int> fact_ids;
+    for (const auto& f : facts) fact_ids.push_back(kb.add_symbol(f));
+    auto t2 = chrono::steady_clock::now();
+    FactSet known;
+    forward_chaining_ids(kb, fact_ids, -1, known);
+    auto t3 = chrono::steady_clock::now();
+
+    bool same = (int)derived.size() == known.count();
+    for (const auto& f : derived) same = same && known.test(kb.symbols.find(f));
+
+    double string_s = chrono::duration<double>(t1 - t0).count();
+    double compile_s = chrono::duration<double>(t2 - t1).count();
+    double ids_s = chrono::duration<double>(t3 - t2).count();
+    cout << num_rules << " rules, " << facts.size() << " facts, " << derived.size() << " in closure\n";
+    cout << "  strings : " << fixed << setprecision(3) << string_s << " s  (" << (long long)(num_rules / string_s)
+         << " rules/s)\n";
+    cout << "  interned: " << ids_s << " s  (" << (long long)(num_rules / ids_s) << " rules/s), compile "
+         << compile_s << " s, index " << kb.index_bytes() / 1024 << " KiB\n";
+    cout << "  closures " << (same ? "match" : "DIFFER") << "\n";
+}
+
+// Facts arrive one at a time with queries in between. Compares the incremental engine
+// against recomputing the closure, then retracts some facts and checks the engine
+// against a closure of the facts that are left.
+void benchmark_incremental(int num_rules) {
+    vector<Rule> rules;
+    unordered_set<string> facts;
+    int num_facts = num_rules / 200;
+    if (num_facts == 0) {
+        cout << "Need at least 200 rules (one fact per 200 rules).\n";
+        return;
+    }
+    make_synthetic_kb(num_rules, num_rules / 4, 3, num_facts, 11, rules, facts);
+    CompiledKB kb = compile_rules(rules);
+    vector<int> fact_ids;
+    for (int f = 0; f < num_facts; ++f) fact_ids.push_back(kb.add_symbol("P" + to_string(f)));
+    int query = kb.add_symbol("P" + to_string(num_rules / 8));
+
+    auto t0 = chrono::steady_clock::now();
+    ForwardEngine engine(kb);
+    int first_held = -1;    // assertions it took until the query held
+    for (int i = 0; i < num_facts; ++i) {
+        engine.assert_fact(fact_ids[i]);
+        if (first_held < 0 && engine.holds(query)) first_held = i + 1;
+    }
+    auto t1 = chrono::steady_clock::now();
+
+    // Recomputing after every fact is quadratic, so time a sample of prefixes and scale.
+    int samples = min(20, num_facts);
+    FactSet closure;
+    for (int s = 1; s <= samples; ++s) {
+        vector<int> prefix(fact_ids.begin(), fact_ids.begin() + (long long)num_facts * s / samples);
+        forward_chaining_ids(kb, prefix, -1, closure);
+    }
+    auto t2 = chrono::steady_clock::now();
+    double incremental_s = chrono::duration<double>(t1 - t0).count();
+    double recompute_s = chrono::duration<double>(t2 - t1).count() * num_facts / samples;
+
+    FactSet full_closure;
+    forward_chaining_ids(kb, fact_ids, -1, full_closure);
+    bool same = full_closure.count() == engine.closure_size();
+    for (int p = 0; p < kb.num_props(); ++p) same = same && full_closure.test(p) == engine.holds(p);
+    ForwardEngine::Snapshot full = engine.snapshot();
+
+    auto t3 = chrono::steady_clock::now();
+    // Every retraction may over-delete most of a dense closure, so only a sample is timed.
+    int num_retracted = min(num_facts / 2, 50);
+    vector<int> kept;
+    for (int i = 0; i < num_facts; ++i) {
+        if (i % 2 && i / 2 < num_retracted) engine.retract(fact_ids[i]);
+        else kept.push_back(fact_ids[i]);
+    }
+    auto t4 = chrono::steady_clock::now();
+    forward_chaining_ids(kb, kept, -1, closure);
+    bool same_after = closure.count() == engine.closure_size();
+    for (int p = 0; p < kb.num_props(); ++p) same_after = same_after && closure.test(p) == engine.holds(p);
+    engine.restore(full);
+    bool restored = engine.closure_size() == full_closure.count();
+    for (int p = 0; p < kb.num_props(); ++p) restored = restored && full_closure.test(p) == engine.holds(p);
+
+    cout << num_rules << " rules, " << num_facts << " facts asserted one by one, closure "
+         << engine.closure_size() << "\n";
+    cout << "  incremental: " << fixed << setprecision(4) << incremental_s << " s, query ";
+    if (first_held < 0) cout << "never held\n";
+    else cout << "first held after assertion " << first_held << "\n";
+    cout << "  recompute  : " << recompute_s << " s (estimated from " << samples << " samples)\n";
+    cout << "  closure " << (same ? "matches" : "DIFFERS") << " the from-scratch closure\n";
+    cout << "  retracting " << num_retracted << " facts: " << chrono::duration<double>(t4 - t3).count()
+         << " s, result " << (same_after ? "matches" : "DIFFERS") << " the closure of the rest\n";
+    cout << "  snapshot restore " << (restored ? "ok" : "FAILED") << "\n";
+}
+
+// Layered KB: layer 0 holds the facts and rule w of layer l concludes L<l>_<w> from
+// random propositions of layer l-1, so the closure needs one round per layer.
+void make_layered_kb(int layers, int width, int max_antecedents, unsigned seed, vector<Rule>& rules,
+                     unordered_set<string>& facts) {
+    mt19937 rng(seed);
+    rules.clear();
+    for (int l = 1; l < layers; ++l)
+        for (int w = 0; w < width; ++w) {
+            Rule rule;
+            int k = 1 + rng() % max_antecedents;
+            for (int i = 0; i < k; ++i)
+                rule.antecedents.push_back("L" + to_string(l - 1) + "_" + to_string(rng() % width));
+            rule.consequent = "L" + to_string(l) + "_" + to_string(w);
+            rules.push_back(move(rule));
+        }
+    facts.clear();
+    for (int w = 0; w < width; ++w) facts.insert("L0_" + to_string(w));
+}
+
+// Times forward_chaining_parallel against forward_chaining_ids on a wide KB (many facts,
+// few rounds) and a deep one (narrow layers, many rounds), checking each closure bit by bit.
+void benchmark_parallel(int num_rules, int max_threads) {
+    auto run = [&](const string& name, const vector<Rule>& rules, const unordered_set<string>& facts) {
+        CompiledKB kb = compile_rules(rules);
+        vector<int> fact_ids;
+        for (const auto& f : facts) fact_ids.push_back(kb.add_symbol(f));
+
+        auto t0 = chrono::steady_clock::now();
+        FactSet serial;
+        forward_chaining_ids(kb, fact_ids, -1, serial);
+        double serial_s = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        cout << name << ": " << rules.size() << " rules, closure " << serial.count() << "\n";
+        cout << "  serial    : " << fixed << setprecision(4) << serial_s << " s\n";
+
+        for (int threads = 1; threads <= max_threads; threads *= 2) {
+            FactSet parallel;
+            auto t1 = chrono::steady_clock::now();
+            forward_chaining_parallel(kb, fact_ids, -1, parallel, threads);
+            double parallel_s = chrono::duration<double>(chrono::steady_clock::now() - t1).count();
+            bool same = parallel.words == serial.words;
+            cout << "  " << setw(2) << threads << " threads: " << parallel_s << " s  (x" << setprecision(2)
+                 << serial_s / parallel_s << setprecision(4) << ")  closure " << (same ? "matches" : "DIFFERS")
+                 << "\n";
+        }
+    };
+
+    vector<Rule> rules;
+    unordered_set<string> facts;
+    make_synthetic_kb(num_rules, num_rules / 4, 3, num_rules / 20, 13, rules, facts);
+    run("wide", rules, facts);
+    make_layered_kb(1000, num_rules / 1000, 1, 17, rules, facts);
+    run("deep", rules, facts);
+}
+
+// Writes a synthetic KB of num_rules rules as text, then times loading it as text
+// with one thread and with all of them, saving the binary image, and mapping it back.
+void benchmark_kb_files(int num_rules, const string& path) {
+    vector<Rule> rules;
+    unordered_set<string> facts;
+    make_synthetic_kb(num_rules, num_rules / 4, 3, num_rules / 200, 19, rules, facts);
+    {
+        ofstream out(path);
+        string line;
+        for (const auto& f : facts) out << f << "\n";
+        for (const auto& r : rules) {
+            line.clear();
+            for (size_t i = 0; i < r.antecedents.size(); ++i) line += (i ? " & " : "") + r.antecedents[i];
+            line += " -> " + r.consequent + "\n";
+            out << line;
+        }
+    }
+    rules.clear();
+    rules.shrink_to_fit();
+
+    auto seconds_since = [](chrono::steady_clock::time_point t) {
+        return chrono::duration<double>(chrono::steady_clock::now() - t).count();
+    };
+    CompiledKB serial, parallel, mapped;
+    auto t0 = chrono::steady_clock::now();
+    bool ok = load_kb_text(path, serial, 1);
+    double serial_s = seconds_since(t0);
+    t0 = chrono::steady_clock::now();
+    ok = load_kb_text(path, parallel) && ok;
+    double parallel_s = seconds_since(t0);
+    string binary_path = path + ".kbc";
+    t0 = chrono::steady_clock::now();
+    ok = save_kb_binary(parallel, binary_path) && ok;
+    double save_s = seconds_since(t0);
+    t0 = chrono::steady_clock::now();
+    ok = load_kb_binary(binary_path, mapped) && ok;
+    double map_s = seconds_since(t0);
+
+    auto same_arrays = [](const Array<int>& a, const Array<int>& b) { return equal(a.begin(), a.end(), b.begin(), b.end()); };
+    bool same = ok && serial.num_props() == mapped.num_props() && same_arrays(serial.rule_start, mapped.rule_start) &&
+                same_arrays(serial.antecedents, mapped.antecedents) && same_arrays(serial.consequent, mapped.consequent) &&
+                same_arrays(serial.facts, mapped.facts) && same_arrays(parallel.antecedents, mapped.antecedents);
+    for (int p = 0; same && p < serial.num_props(); ++p)
+        same = serial.symbols.name(p) == mapped.symbols.name(p) && mapped.symbols.find(serial.symbols.name(p)) == p;
+
+    FactSet from_text, from_binary;
+    forward_chaining_ids(serial, vector<int>(serial.facts.begin(), serial.facts.end()), -1, from_text);
+    t0 = chrono::steady_clock::now();
+    forward_chaining_ids(mapped, vector<int>(mapped.facts.begin(), mapped.facts.end()), -1, from_binary);
+    double closure_s = seconds_since(t0);
+    same = same && from_text.words == from_binary.words;
+
+    struct stat text_st, binary_st;
+    stat(path.c_str(), &text_st);
+    stat(binary_path.c_str(), &binary_st);
+    cout << num_rules << " rules, " << serial.num_props() << " symbols, text " << text_st.st_size / (1 << 20)
+         << " MiB, binary " << binary_st.st_size / (1 << 20) << " MiB\n";
+    cout << "  text, 1 thread : " << fixed << setprecision(4) << serial_s << " s\n";
+    cout << "  text, " << setw(2) << max(1u, thread::hardware_concurrency()) << " threads: " << parallel_s << " s\n";
+    cout << "  save binary    : " << save_s << " s\n";
+    cout << "  map binary     : " << map_s << " s  (closure from the mapping " << closure_s << " s)\n";
+    cout << "  loads " << (same ? "agree" : "DIFFER") << "\n";
+    remove(path.c_str());
+    remove(binary_path.c_str());
+}
+
+// Matches every rule against every fact, round after round, until nothing new is
+// derived: what the network avoids. Returns the number of rounds.
+int naive_var_closure(const vector<VarRule>& rules, AtomStore& facts) {
+    int rounds = 0;
+    for (bool changed = true; changed; ++rounds) {
+        changed = false;
+        int known = facts.size();
+        unordered_map<int, vector<int>> by_pred;
+        for (int f = 0; f < known; ++f) by_pred[facts.pred(f)].push_back(f);
+        for (const VarRule& rule : rules) {
+            vector<int> binding(rule.num_vars, -1);
+            function<void(int)> match = [&](int level) {
+                if (level == (int)rule.body.size()) {
+                    vector<int> args;
+                    for (int a : rule.head.args) args.push_back(a >= 0 ? a : binding[-1 - a]);
+                    changed = facts.insert(rule.head.pred, args.data(), (int)args.size()).second || changed;
+                    return;
+                }
+                const Atom& atom = rule.body[level];
+                for (int f : by_pred[atom.pred]) {
+                    if (facts.arity(f) != (int)atom.args.size()) continue;
+                    vector<int> saved = binding;
+                    bool ok = true;
+                    for (int i = 0; i < (int)atom.args.size() && ok; ++i) {
+                        int value = facts.args(f)[i];
+                        if (atom.args[i] >= 0) ok = atom.args[i] == value;
+                        else if (binding[-1 - atom.args[i]] < 0) binding[-1 - atom.args[i]] = value;
+                        else ok = binding[-1 - atom.args[i]] == value;
+                    }
+                    if (ok) match(level + 1);
+                    binding = saved;
+                }
+            };
+            match(0);
+        }
+    }
+    return rounds;
+}
+
+// A random family tree of num_people people with kinship rules: the full closure by
+// the network and by naive re-matching, then people added one at a time.
+vector<VarRule> kinship_rules(SymbolTable& symbols) {
+    vector<VarRule> rules;
+    for (const char* text : {"parent(X,Y) -> ancestor(X,Y)", "ancestor(X,Y) & parent(Y,Z) -> ancestor(X,Z)",
+                             "parent(X,Y) & parent(Y,Z) -> grandparent(X,Z)",
+                             "parent(P,X) & parent(P,Y) -> sibling(X,Y)",
+                             "sibling(A,B) & parent(A,X) & parent(B,Y) -> cousin(X,Y)"}) {
+        VarRule rule;
+        parse_var_rule(text, symbols, rule);
+        rules.push_back(rule);
+    }
+    return rules;
+}
+
+void benchmark_rete(int num_people) {
+    SymbolTable symbols;
+    vector<VarRule> rules = kinship_rules(symbols);
+    int parent = symbols.intern("parent");
+    mt19937 rng(23);
+    auto person = [&](int i) { return symbols.intern("p" + to_string(i)); };
+    vector<Atom> parents;
+    for (int i = 1; i < num_people; ++i) parents.push_back({parent, {person(rng() % i), person(i)}});
+
+    auto t0 = chrono::steady_clock::now();
+    ReteEngine engine(rules);
+    for (const Atom& a : parents) engine.assert_fact(a);
+    auto t1 = chrono::steady_clock::now();
+    AtomStore naive;
+    for (const Atom& a : parents) naive.insert(a.pred, a.args.data(), (int)a.args.size());
+    int rounds = naive_var_closure(rules, naive);
+    auto t2 = chrono::steady_clock::now();
+
+    bool same = naive.size() == engine.atoms().size();
+    for (int f = 0; f < naive.size() && same; ++f)
+        same = engine.holds({naive.pred(f), vector<int>(naive.args(f), naive.args(f) + naive.arity(f))});
+    double rete_s = chrono::duration<double>(t1 - t0).count();
+    double naive_s = chrono::duration<double>(t2 - t1).count();
+    cout << num_people << " people, " << rules.size() << " rules, " << engine.atoms().size() << " facts in closure\n";
+    cout << "  rete : " << fixed << setprecision(4) << rete_s << " s, " << engine.activations() << " join attempts\n";
+    cout << "  naive: " << naive_s << " s, " << rounds << " rounds\n";
+    cout << "  closures " << (same ? "match" : "DIFFER") << "\n";
+
+    // New people, one at a time: the network only joins the new facts.
+    int added = 100;
+    long long before = engine.activations();
+    auto t3 = chrono::steady_clock::now();
+    for (int i = num_people; i < num_people + added; ++i) engine.assert_fact({parent, {person(rng() % i), person(i)}});
+    auto t4 = chrono::steady_clock::now();
+    cout << "  adding " << added << " people: " << chrono::duration<double>(t4 - t3).count() / added * 1e6
+         << " us per fact (" << (engine.activations() - before) / added << " join attempts each); naive re-matching "
+         << "takes " << naive_s << " s per change\n";
+}
+
+// The grandparent example with a handful of facts.
+void rete_demo() {
+    SymbolTable symbols;
+    vector<VarRule> rules(1);
+    parse_var_rule("parent(X,Y) & parent(Y,Z) -> grandparent(X,Z)", symbols, rules[0]);
+    ReteEngine engine(rules);
+    for (const char* text : {"parent(ann,bob)", "parent(bob,carl)", "parent(bob,dana)", "parent(dana,eve)"}) {
+        Atom fact;
+        parse_atom(text, symbols, nullptr, fact);
+        engine.assert_fact(fact);
+    }
+    cout << "Derived facts:\n";
+    for (int f = 0; f < engine.atoms().size(); ++f) cout << "- " << engine.atoms().text(f, symbols) << '\n';
+    cout << '\n';
+}
+
+// One JSON line per engine in the schema of instrumentation.h, on a synthetic
+// propositional KB of num_rules rules and the kinship rules over num_people people.
+void json_report(int num_rules, int num_people) {
+    vector<Rule> rules;
+    unordered_set<string> facts;
+    make_synthetic_kb(num_rules, num_rules / 4, 3, num_rules / 200, 7, rules, facts);
+    CompiledKB kb = compile_rules(rules);
+    vector<int> fact_ids;
+    for (const auto& f : facts) fact_ids.push_back(kb.add_symbol(f));
+    string instance = to_string(num_rules) + " random rules";
+    {
+        instr::Run run("forward chaining", instance);
+        FactSet known;
+        forward_chaining_ids(kb, fact_ids, -1, known);
+        run.extra("closure", known.count());
+        cout << run.finish() << "\n";
+    }
+    {
+        int threads = (int)max(1u, thread::hardware_concurrency());
+        instr::Run run("parallel forward chaining", instance);
+        FactSet known;
+        forward_chaining_parallel(kb, fact_ids, -1, known, threads);
+        run.extra("closure", known.count()).extra("threads", threads);
+        cout << run.finish() << "\n";
+    }
+    {
+        instr::Run run("incremental forward chaining", instance + ", facts asserted one at a time");
+        ForwardEngine engine(kb);
+        for (int f : fact_ids) engine.assert_fact(f);
+        run.extra("closure", engine.closure_size());
+        cout << run.finish() << "\n";
+    }
+    {
+        SymbolTable symbols;
+        vector<VarRule> var_rules = kinship_rules(symbols);
+        int parent = symbols.intern("parent");
+        mt19937 rng(23);
+        auto person = [&](int i) { return symbols.intern("p" + to_string(i)); };
+        instr::Run run("rete", to_string(num_people) + " people, kinship rules");
+        ReteEngine engine(var_rules);
+        for (int i = 1; i < num_people; ++i) engine.assert_fact({parent, {person(rng() % i), person(i)}});
+        run.extra("closure", engine.atoms().size());
+        cout << run.finish() << "\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    // One JSON line per engine (schema in instrumentation.h); build with
+    // -DINSTRUMENTATION=1 for the work counters.
+    if (argc >= 2 && string(argv[1]) == "--json") {
+        json_report(argc >= 3 ? atoi(argv[2]) : 1000000, argc >= 4 ? atoi(argv[3]) : 600);
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--bench") {
+        benchmark_interned(argc >= 3 ? atoi(argv[2]) : 1000000);
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--incremental") {
+        benchmark_incremental(argc >= 3 ? atoi(argv[2]) : 1000000);
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--kb-bench") {
+        benchmark_kb_files(argc >= 3 ? atoi(argv[2]) : 10000000, "kb_bench.txt");
+        return 0;
+    }
+    if (argc >= 4 && string(argv[1]) == "--compile-kb") {
+        CompiledKB kb;
+        if (!load_kb(argv[2], kb) || !save_kb_binary(kb, argv[3])) {
+            cerr << "Could not compile " << argv[2] << " to " << argv[3] << "\n";
+            return 1;
+        }
+        cout << "Wrote " << kb.num_rules() << " rules over " << kb.num_props() << " symbols to " << argv[3] << "\n";
+        return 0;
+    }
+    if (argc >= 3 && string(argv[1]) == "--kb") {
+        // Whole closure of a KB file (text or binary), or just the query if one is given.
+        CompiledKB kb;
+        if (!load_kb(argv[2], kb)) {
+            cerr << "Could not load " << argv[2] << "\n";
+            return 1;
+        }
+        int query = argc >= 4 ? kb.symbols.find(argv[3]) : -1;
+        FactSet known;
+        bool entailed = forward_chaining_ids(kb, vector<int>(kb.facts.begin(), kb.facts.end()), query, known);
+        cout << kb.num_rules() << " rules, " << kb.facts.size() << " facts, " << known.count() << " derived\n";
+        if (argc >= 4)
+            cout << "Is \"" << argv[3] << "\" entailed by the KB? " << (entailed ? "YES" : "NO") << '\n';
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--rete") {
+        rete_demo();
+        benchmark_rete(argc >= 3 ? atoi(argv[2]) : 600);
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--parallel") {
+        int threads = argc >= 4 ? atoi(argv[3]) : (int)max(1u, thread::hardware_concurrency());
+        benchmark_parallel(argc >= 3 ? atoi(argv[2]) : 1000000, threads);
+        return 0;
+    }
+
     // Example: knowledge base
     // Facts: P, Q
     // Rules:
@@ -1,4 +1,6 @@
 #include <bits/stdc++.h>
+#include "../common/instrumentation.h"
+#include "../common/knowledge_base.h"
 using namespace std;
 
 struct Rule {
@@ -7,11 +9,20 @@ struct Rule {
 };
 
 bool backwardChaining(string goal, vector<Rule>& rules, set<string>& facts, set<string>& visited) {
-    if (facts.count(goal)) return true;
-    if (visited.count(goal)) return false;
+    INSTR_COUNT(TABLE_PROBES);
+    if (facts.count(goal)) {
+        INSTR_COUNT(TABLE_HITS);
+        return true;
+    }
+    if (visited.count(goal)) {
+        INSTR_COUNT(PRUNED);
+        return false;
+    }
     visited.insert(goal);
+    INSTR_COUNT(NODES_EXPANDED);
     for (auto& rule : rules) {
         if (rule.conclusion == goal) {
+            INSTR_COUNT(NODES_GENERATED);
             bool ok = true;
             for (auto& p : rule.premises) {
                 if (!backwardChaining(p, rules, facts, visited)) {
@@ -20,6 +31,8 @@ bool backwardChaining(string goal, vector<Rule>& rules, set<string>& facts, set<
                 }
             }
             if (ok) {
+                INSTR_COUNT(RULES_FIRED);
+                INSTR_COUNT(FACTS_DERIVED);
                 facts.insert(goal);
                 return true;
             }
@@ -28,7 +41,767 @@ bool backwardChaining(string goal, vector<Rule>& rules, set<string>& facts, set<
     return false;
 }
 
-int main() {
+enum GoalStatus : char { UNKNOWN, OPEN, PROVEN, FAILED };
+
+// Answers settled by any of several provers over the same KB and facts. A goal that
+// is proven, or failed after its component was completed, stays so for everyone.
+struct SharedAnswers {
+    vector<atomic<char>> status;
+    atomic<bool> cancel{false};     // set to make the provers using this give up
+
+    explicit SharedAnswers(int numProps) : status(numProps) {}
+};
+
+// Backward chaining over interned ids with tabling. Every goal gets a table entry
+// that is filled in once and kept across queries, and only the rules that conclude a
+// goal are looked at (through kb's conclusion index), so each subgoal is solved at
+// most once.
+//
+// A goal that fails while some goal it depends on is still being solved is left
+// open instead of being cached as false. The open goals form strongly connected
+// components (found Tarjan style on the goal stack); when the leader of a component
+// finishes, the component is completed at once: its least fixpoint is computed from
+// the rules of its members, whose other premises are all settled by then, and the
+// members not derived are marked as failed.
+//
+// The search does not recurse: the goals being solved are frames in an array with
+// one slot per proposition, allocated up front (a goal is never on it twice), so
+// derivation chains of any depth run in bounded memory.
+class TabledProver {
+public:
+    TabledProver(const CompiledKB& kb, const vector<int>& facts, SharedAnswers* shared = nullptr)
+        : kb(kb), shared(shared), status(kb.num_props(), UNKNOWN), order(kb.num_props()), low(kb.num_props()),
+          pending(kb.num_rules(), -1), frames(kb.num_props()) {
+        for (int f : facts) status[f] = PROVEN;
+    }
+
+    // False if the goal cannot be proven, or if the shared cancel flag was raised.
+    bool prove(int goal) {
+        if (goal < 0 || goal >= kb.num_props()) return false;
+        if (lookup(goal) == UNKNOWN) solve(goal);
+        return status[goal] == PROVEN;
+    }
+
+    int goalsSolved() const { return solved; }
+
+private:
+    using Status = GoalStatus;
+
+    struct Frame {
+        int goal;
+        int rule;       // position in the goal's conclusion_rules
+        int premise;    // position in antecedents, or -1 before the rule is started
+        bool ok;        // every premise so far is proven
+    };
+
+    const CompiledKB& kb;
+    SharedAnswers* shared;
+    vector<Status> status;
+    vector<int> order, low;     // Tarjan numbering of the open goals
+    vector<int> openGoals;      // goal stack, by order
+    vector<int> pending;        // premises of a rule still open while its component completes
+    vector<Frame> frames;
+    int solved = 0;
+
+    Status lookup(int p) {
+        INSTR_COUNT(TABLE_PROBES);
+        if (status[p] == UNKNOWN && shared) {
+            char answer = shared->status[p].load(memory_order_relaxed);
+            if (answer == PROVEN || answer == FAILED) status[p] = Status(answer);
+        }
+        if (status[p] != UNKNOWN) INSTR_COUNT(TABLE_HITS);
+        return status[p];
+    }
+
+    void settle(int p, Status answer) {
+        if (answer == PROVEN) INSTR_COUNT(FACTS_DERIVED);
+        status[p] = answer;
+        if (shared) shared->status[p].store(answer, memory_order_relaxed);
+    }
+
+    void open(int goal, int& top) {
+        order[goal] = low[goal] = solved++;
+        INSTR_COUNT(NODES_EXPANDED);
+        status[goal] = OPEN;
+        openGoals.push_back(goal);
+        frames[top++] = {goal, kb.conclusion_start[goal], -1, true};
+    }
+
+    void solve(int goal) {
+        int top = 0;
+        open(goal, top);
+        for (long steps = 0; top > 0; ++steps) {
+            if ((steps & 1023) == 0 && shared && shared->cancel.load(memory_order_relaxed)) {
+                abandon();
+                return;
+            }
+            Frame& f = frames[top - 1];
+            int g = f.goal;
+            if (f.premise < 0) {
+                if (status[g] != OPEN || f.rule == kb.conclusion_start[g + 1]) {
+                    // Every rule tried: the goal is done, and so is its component if it leads one.
+                    --top;
+                    if (low[g] == order[g]) complete(g);
+                    // Even if g is proven, its subgoals may still be open.
+                    if (top > 0) low[frames[top - 1].goal] = min(low[frames[top - 1].goal], low[g]);
+                    continue;
+                }
+                f.premise = kb.rule_start[kb.conclusion_rules[f.rule]];
+                f.ok = true;
+                INSTR_COUNT(NODES_GENERATED);
+            }
+            int r = kb.conclusion_rules[f.rule];
+            if (f.premise == kb.rule_start[r + 1]) {
+                if (f.ok) {
+                    INSTR_COUNT(RULES_FIRED);
+                    settle(g, PROVEN);
+                }
+                ++f.rule;
+                f.premise = -1;
+                continue;
+            }
+            int p = kb.antecedents[f.premise];
+            Status ps = lookup(p);
+            if (ps == UNKNOWN) {
+                open(p, top);   // f is looked at again, with p solved, once p's frame is done
+                continue;
+            }
+            if (ps == OPEN) low[g] = min(low[g], order[p]);
+            if (ps == FAILED) {
+                INSTR_COUNT(PRUNED);
+                ++f.rule;
+                f.premise = -1;
+                continue;
+            }
+            f.ok = f.ok && ps == PROVEN;
+            ++f.premise;
+        }
+    }
+
+    // Drops every goal still open, so the settled part of the table stays usable.
+    void abandon() {
+        for (int g : openGoals)
+            if (status[g] == OPEN) status[g] = UNKNOWN;
+        openGoals.clear();
+    }
+
+    void complete(int leader) {
+        vector<int> members;
+        int g;
+        do {
+            g = openGoals.back();
+            openGoals.pop_back();
+            if (status[g] == OPEN) members.push_back(g);
+        } while (g != leader);
+
+        // Count the open premises of each member's rules; rules with a failed premise never fire.
+        vector<int> agenda;
+        for (int m : members)
+            for (int i = kb.conclusion_start[m]; i < kb.conclusion_start[m + 1]; ++i) {
+                int r = kb.conclusion_rules[i], open = 0;
+                bool dead = false;
+                for (int j = kb.rule_start[r]; j < kb.rule_start[r + 1] && !dead; ++j) {
+                    dead = status[kb.antecedents[j]] == FAILED;
+                    open += status[kb.antecedents[j]] == OPEN;
+                }
+                if (dead) continue;
+                pending[r] = open;
+                if (open == 0) agenda.push_back(m);
+            }
+        for (size_t head = 0; head < agenda.size(); ++head) {
+            int p = agenda[head];
+            if (status[p] != OPEN) continue;
+            INSTR_COUNT(RULES_FIRED);
+            settle(p, PROVEN);
+            for (int i = kb.prop_start[p]; i < kb.prop_start[p + 1]; ++i) {
+                int r = kb.prop_rules[i];
+                if (pending[r] > 0 && --pending[r] == 0 && status[kb.consequent[r]] == OPEN)
+                    agenda.push_back(kb.consequent[r]);
+            }
+        }
+        for (int m : members)
+            if (status[m] == OPEN) settle(m, FAILED);
+    }
+};
+
+// Worker threads that run batches of tasks: run(n, task) calls task(i, worker) for
+// i = 0 .. n-1, spread over the workers (the caller is worker 0), and returns when
+// all of them are done.
+class ThreadPool {
+public:
+    explicit ThreadPool(int numThreads) : numWorkers(max(1, numThreads)) {
+        for (int w = 1; w < numWorkers; ++w) workers.emplace_back([this, w] { workerLoop(w); });
+    }
+
+    ~ThreadPool() {
+        {
+            lock_guard<mutex> lock(m);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& t : workers) t.join();
+    }
+
+    int size() const { return numWorkers; }
+
+    void run(int numTasks, const function<void(int, int)>& task) {
+        {
+            lock_guard<mutex> lock(m);
+            batch = &task;
+            batchSize = numTasks;
+            nextTask = 0;
+            busy = numWorkers - 1;
+            ++generation;
+        }
+        wake.notify_all();
+        work(0);
+        unique_lock<mutex> lock(m);
+        done.wait(lock, [this] { return busy == 0; });
+    }
+
+private:
+    int numWorkers;
+    vector<thread> workers;
+    mutex m;
+    condition_variable wake, done;
+    const function<void(int, int)>* batch = nullptr;
+    int batchSize = 0, busy = 0;
+    atomic<int> nextTask{0};
+    long generation = 0;
+    bool stopping = false;
+
+    void work(int worker) {
+        for (int i; (i = nextTask.fetch_add(1)) < batchSize;) (*batch)(i, worker);
+    }
+
+    void workerLoop(int worker) {
+        long seen = 0;
+        for (;;) {
+            {
+                unique_lock<mutex> lock(m);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+            }
+            work(worker);
+            lock_guard<mutex> lock(m);
+            if (--busy == 0) done.notify_one();
+        }
+    }
+};
+
+// Tries the rules that conclude a goal (its OR-branches) at the same time, one per
+// worker. The workers keep their own tabled provers but publish every settled answer,
+// so work done in one branch is reused by the others; as soon as one branch proves
+// the goal the rest are cancelled.
+class ParallelProver {
+public:
+    ParallelProver(const CompiledKB& kb, const vector<int>& facts, int numThreads = 0)
+        : kb(kb), answers(kb.num_props()),
+          pool(numThreads > 0 ? numThreads : (int)max(1u, thread::hardware_concurrency())) {
+        for (int f : facts) answers.status[f] = PROVEN;
+        for (int w = 0; w < pool.size(); ++w) provers.push_back(make_unique<TabledProver>(kb, facts, &answers));
+    }
+
+    bool prove(int goal) {
+        if (goal < 0 || goal >= kb.num_props()) return false;
+        char known = answers.status[goal].load();
+        if (known == PROVEN || known == FAILED) return known == PROVEN;
+
+        int first = kb.conclusion_start[goal], branches = kb.conclusion_start[goal + 1] - first;
+        atomic<bool> proven{false};
+        answers.cancel = false;
+        pool.run(branches, [&](int branch, int worker) {
+            int r = kb.conclusion_rules[first + branch];
+            bool ok = true;
+            for (int i = kb.rule_start[r]; i < kb.rule_start[r + 1] && ok && !answers.cancel; ++i)
+                ok = provers[worker]->prove(kb.antecedents[i]);
+            if (ok && !answers.cancel.exchange(true)) proven = true;
+        });
+        answers.cancel = false;
+        answers.status[goal] = proven ? PROVEN : FAILED;
+        return proven;
+    }
+
+private:
+    const CompiledKB& kb;
+    SharedAnswers answers;
+    ThreadPool pool;
+    vector<unique_ptr<TabledProver>> provers;
+};
+
+// Picks, per query, how to answer it, from what it knows about the KB and from how
+// fast each strategy has been so far:
+//   CACHED    the answer is already known (every strategy leaves its answers behind)
+//   BACKWARD  the tabled prover, goal-directed
+//   MAGIC     the goal's cone (everything it can depend on, the "magic set") is found
+//             first, then only the rules inside it are run forward
+//   FORWARD   the whole closure, after which every query is cached
+// Before choosing it walks the goal's cone back through the conclusion index, giving
+// up once the cone holds a quarter of the KB: such a query needs most of the closure
+// anyway, and computing all of it pays off for the queries that follow.
+class QueryPlanner {
+public:
+    enum Plan { CACHED, BACKWARD, MAGIC, FORWARD };
+
+    struct Report {
+        bool proven;
+        Plan plan;
+        long long coneEdges;    // -1 if the walk gave up
+        double estimate, seconds;
+    };
+
+    explicit QueryPlanner(const CompiledKB& kb)
+        : kb(kb), answers(kb.num_props()), prover(kb, vector<int>(kb.facts.begin(), kb.facts.end()), &answers),
+          seen(kb.num_props(), 0), ruleSeen(kb.num_rules(), 0), count(kb.num_rules()) {
+        for (int f : kb.facts) answers.status[f] = PROVEN;
+        totalEdges = (long long)kb.antecedents.size() + kb.num_rules();
+    }
+
+    static const char* planName(Plan plan) {
+        static const char* names[] = {"cached", "backward", "magic", "forward"};
+        return names[plan];
+    }
+
+    Report query(int goal) {
+        auto t0 = chrono::steady_clock::now();
+        Report report{false, CACHED, 0, 0, 0};
+        if (goal < 0 || goal >= kb.num_props()) return report;
+        if (settled(goal)) {
+            report.proven = answers.status[goal] == PROVEN;
+            report.seconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+            ++cachedQueries;
+            return report;
+        }
+
+        report.coneEdges = walkCone(goal, totalEdges / 4);
+        if (report.coneEdges < 0) {
+            report.plan = FORWARD;
+            report.estimate = totalEdges * nsPerEdge[FORWARD];
+        } else {
+            double backward = report.coneEdges * nsPerEdge[BACKWARD], magic = report.coneEdges * nsPerEdge[MAGIC];
+            double forward = totalEdges * nsPerEdge[FORWARD];
+            report.plan = backward <= magic && backward <= forward ? BACKWARD : magic <= forward ? MAGIC : FORWARD;
+            report.estimate = min({backward, magic, forward});
+        }
+
+        long long edges = report.plan == FORWARD ? totalEdges : report.coneEdges;
+        if (report.plan == BACKWARD) {
+            prover.prove(goal);
+        } else {
+            if (report.plan == FORWARD) {
+                cone.clear();
+                for (int p = 0; p < kb.num_props(); ++p)
+                    if (!settled(p)) cone.push_back(p);
+            }
+            bottomUp();
+        }
+        report.proven = answers.status[goal] == PROVEN;
+        report.seconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        // Keep a running cost per edge, so later estimates follow what was measured.
+        if (edges > 0) nsPerEdge[report.plan] = 0.7 * nsPerEdge[report.plan] + 0.3 * report.seconds * 1e9 / edges;
+        report.estimate *= 1e-9;
+        ++plannedQueries[report.plan];
+        return report;
+    }
+
+    void printStatistics(ostream& out) const {
+        long long maxIn = 0, maxOut = 0;
+        for (int p = 0; p < kb.num_props(); ++p) {
+            maxIn = max<long long>(maxIn, kb.conclusion_start[p + 1] - kb.conclusion_start[p]);
+            maxOut = max<long long>(maxOut, kb.prop_start[p + 1] - kb.prop_start[p]);
+        }
+        int proven = 0, known = 0;
+        for (int p = 0; p < kb.num_props(); ++p) {
+            proven += answers.status[p] == PROVEN;
+            known += settled(p);
+        }
+        double props = max(1, kb.num_props());
+        out << kb.num_props() << " propositions, " << kb.num_rules() << " rules\n";
+        out << "  fan-in  (rules concluding a proposition): mean " << fixed << setprecision(2)
+            << kb.num_rules() / props << ", max " << maxIn << "\n";
+        out << "  fan-out (rules using a proposition)     : mean " << kb.antecedents.size() / props << ", max "
+            << maxOut << "\n";
+        out << "  answers cached: " << known << " (" << proven << " proven)"
+            << (plannedQueries[FORWARD] ? ", closure complete" : "") << "\n";
+        out << "  queries: " << cachedQueries << " cached, " << plannedQueries[BACKWARD] << " backward, "
+            << plannedQueries[MAGIC] << " magic, " << plannedQueries[FORWARD] << " forward\n";
+        out << "  cost per edge (ns): backward " << nsPerEdge[BACKWARD] << ", magic " << nsPerEdge[MAGIC]
+            << ", forward " << nsPerEdge[FORWARD] << "\n";
+    }
+
+private:
+    const CompiledKB& kb;
+    SharedAnswers answers;      // one table for every strategy
+    TabledProver prover;
+    vector<int> seen, ruleSeen, count, cone;
+    int stamp = 0;
+    long long totalEdges;
+    double nsPerEdge[4] = {0, 20, 10, 5};   // starting guesses, replaced by measurements
+    int cachedQueries = 0, plannedQueries[4] = {0, 0, 0, 0};
+
+    bool settled(int p) const {
+        char s = answers.status[p].load(memory_order_relaxed);
+        return s == PROVEN || s == FAILED;
+    }
+
+    // Collects the unsettled propositions the goal depends on into cone and returns the
+    // number of rule edges among them, or -1 if that passes the budget.
+    long long walkCone(int goal, long long budget) {
+        ++stamp;
+        cone.assign(1, goal);
+        seen[goal] = stamp;
+        long long edges = 0;
+        for (size_t head = 0; head < cone.size(); ++head) {
+            int p = cone[head];
+            for (int i = kb.conclusion_start[p]; i < kb.conclusion_start[p + 1]; ++i) {
+                int r = kb.conclusion_rules[i];
+                edges += 1 + kb.rule_start[r + 1] - kb.rule_start[r];
+                if (edges > budget) return -1;
+                for (int j = kb.rule_start[r]; j < kb.rule_start[r + 1]; ++j) {
+                    int q = kb.antecedents[j];
+                    if (seen[q] != stamp && !settled(q)) {
+                        seen[q] = stamp;
+                        cone.push_back(q);
+                    }
+                }
+            }
+        }
+        return edges;
+    }
+
+    // Forward chaining restricted to the rules that conclude something in cone. The
+    // cone is closed under dependencies, so whatever in it is not derived is false.
+    void bottomUp() {
+        ++stamp;
+        for (int p : cone) seen[p] = stamp;
+        vector<int> agenda;
+        for (int p : cone)
+            for (int i = kb.conclusion_start[p]; i < kb.conclusion_start[p + 1]; ++i) {
+                int r = kb.conclusion_rules[i], open = 0;
+                bool dead = false;
+                for (int j = kb.rule_start[r]; j < kb.rule_start[r + 1] && !dead; ++j) {
+                    char s = answers.status[kb.antecedents[j]].load(memory_order_relaxed);
+                    dead = s == FAILED;
+                    open += s != PROVEN;
+                }
+                if (dead) continue;
+                ruleSeen[r] = stamp;
+                count[r] = open;
+                if (open == 0) agenda.push_back(p);
+            }
+        for (size_t head = 0; head < agenda.size(); ++head) {
+            int p = agenda[head];
+            if (settled(p)) continue;
+            INSTR_COUNT(RULES_FIRED);
+            INSTR_COUNT(FACTS_DERIVED);
+            answers.status[p] = PROVEN;
+            for (int i = kb.prop_start[p]; i < kb.prop_start[p + 1]; ++i) {
+                int r = kb.prop_rules[i];
+                if (ruleSeen[r] == stamp && --count[r] == 0) agenda.push_back(kb.consequent[r]);
+            }
+        }
+        for (int p : cone)
+            if (!settled(p)) answers.status[p] = FAILED;
+    }
+};
+
+// Closure of the KB by naive forward iteration, as a reference answer for every goal.
+vector<char> referenceClosure(const CompiledKB& kb) {
+    vector<char> known(kb.num_props(), 0);
+    for (int f : kb.facts) known[f] = 1;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (int r = 0; r < kb.num_rules(); ++r) {
+            bool ok = !known[kb.consequent[r]];
+            for (int i = kb.rule_start[r]; i < kb.rule_start[r + 1] && ok; ++i) ok = known[kb.antecedents[i]];
+            if (ok) known[kb.consequent[r]] = changed = true;
+        }
+    }
+    return known;
+}
+
+// Interns facts and rules into a CompiledKB, numbering symbols in the order that
+// load_kb_text would give a file listing the facts and then the rules. A rule without
+// premises is a fact, as in the text format.
+CompiledKB compileRules(const vector<Rule>& rules, const set<string>& facts) {
+    CompiledKB kb;
+    vector<int> ruleStart{0}, antecedents, consequent, factIds;
+    for (const auto& f : facts) factIds.push_back(kb.symbols.intern(f));
+    for (const auto& rule : rules) {
+        if (rule.premises.empty()) {
+            factIds.push_back(kb.symbols.intern(rule.conclusion));
+            continue;
+        }
+        for (const auto& premise : rule.premises) antecedents.push_back(kb.symbols.intern(premise));
+        ruleStart.push_back((int)antecedents.size());
+        consequent.push_back(kb.symbols.intern(rule.conclusion));
+    }
+    kb.rule_start = Array<int>(move(ruleStart));
+    kb.antecedents = Array<int>(move(antecedents));
+    kb.consequent = Array<int>(move(consequent));
+    kb.facts = Array<int>(move(factIds));
+    kb.build_index();
+    return kb;
+}
+
+// Random KBs full of cycles: every goal is checked with a fresh prover and with one
+// shared prover against the forward closure, and also with backwardChaining.
+void checkTabling(int rounds) {
+    mt19937 rng(5);
+    int tabledWrong = 0, parallelWrong = 0, originalWrong = 0, goals = 0;
+    for (int round = 0; round < rounds; ++round) {
+        int props = 10 + rng() % 40;
+        vector<Rule> rules(props + rng() % (2 * props));
+        for (auto& rule : rules) {
+            int k = 1 + rng() % 3;
+            for (int i = 0; i < k; ++i) rule.premises.push_back("P" + to_string(rng() % props));
+            rule.conclusion = "P" + to_string(rng() % props);
+        }
+        set<string> facts;
+        for (int f = 0, n = 1 + rng() % 4; f < n; ++f) facts.insert("P" + to_string(rng() % props));
+        CompiledKB kb = compileRules(rules, facts);
+        vector<char> expected = referenceClosure(kb);
+        vector<int> factIds(kb.facts.begin(), kb.facts.end());
+        TabledProver shared(kb, factIds);
+        ParallelProver parallel(kb, factIds, 3);
+        for (int g = 0; g < kb.num_props(); ++g) {
+            TabledProver fresh(kb, factIds);
+            tabledWrong += (fresh.prove(g) != (bool)expected[g]) + (shared.prove(g) != (bool)expected[g]);
+            parallelWrong += parallel.prove(g) != (bool)expected[g];
+            set<string> known = facts, visited;
+            originalWrong += backwardChaining(string(kb.symbols.name(g)), rules, known, visited) != (bool)expected[g];
+            ++goals;
+        }
+    }
+    cout << goals << " goals in " << rounds << " random KBs\n";
+    cout << "  tabled prover wrong   : " << tabledWrong << "\n";
+    cout << "  parallel prover wrong : " << parallelWrong << "\n";
+    cout << "  backwardChaining wrong: " << originalWrong << "  (failures cached inside cycles)\n";
+}
+
+// A chain P0 -> P1 -> ... -> Pdepth with every link also pointing back, so each
+// goal sits in a cycle. backwardChaining scans every rule per subgoal.
+void benchmarkTabling(int depth) {
+    vector<Rule> rules;
+    for (int i = 0; i < depth; ++i) {
+        rules.push_back({{"P" + to_string(i)}, "P" + to_string(i + 1)});
+        rules.push_back({{"P" + to_string(i + 1)}, "P" + to_string(i)});
+    }
+    set<string> facts = {"P0"};
+    string goal = "P" + to_string(depth);
+
+    auto t0 = chrono::steady_clock::now();
+    set<string> known = facts, visited;
+    bool original = backwardChaining(goal, rules, known, visited);
+    auto t1 = chrono::steady_clock::now();
+    CompiledKB kb = compileRules(rules, facts);
+    auto t2 = chrono::steady_clock::now();
+    TabledProver prover(kb, vector<int>(kb.facts.begin(), kb.facts.end()));
+    bool tabled = prover.prove(kb.symbols.find(goal));
+    auto t3 = chrono::steady_clock::now();
+
+    cout << rules.size() << " rules, chain depth " << depth << "\n";
+    cout << "  backwardChaining: " << fixed << setprecision(4) << chrono::duration<double>(t1 - t0).count()
+         << " s, " << (original ? "proven" : "not proven") << "\n";
+    cout << "  tabled prover   : " << chrono::duration<double>(t3 - t2).count() << " s, "
+         << (tabled ? "proven" : "not proven") << ", " << prover.goalsSolved() << " goals solved (compile "
+         << chrono::duration<double>(t2 - t1).count() << " s)\n";
+}
+
+// A goal G with `branches` rules G <- Bk_depth, each the end of a chain
+// Bk_0 -> Bk_1 -> ... -> Bk_depth. Only the last chain starts from a fact, so trying
+// the branches in order walks every dead chain first.
+void benchmarkOrBranches(int branches, int depth, int maxThreads) {
+    vector<Rule> rules;
+    for (int k = 0; k < branches; ++k) {
+        string chain = "B" + to_string(k) + "_";
+        for (int i = 0; i < depth; ++i) rules.push_back({{chain + to_string(i)}, chain + to_string(i + 1)});
+        rules.push_back({{chain + to_string(depth)}, "G"});
+    }
+    set<string> facts = {"B" + to_string(branches - 1) + "_0"};
+    CompiledKB kb = compileRules(rules, facts);
+    vector<int> factIds(kb.facts.begin(), kb.facts.end());
+    int goal = kb.symbols.find("G");
+    cout << rules.size() << " rules, " << branches << " OR-branches of depth " << depth << "\n";
+
+    auto t0 = chrono::steady_clock::now();
+    TabledProver serial(kb, factIds);
+    bool serialAnswer = serial.prove(goal);
+    double serialTime = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    cout << "  iterative, serial: " << fixed << setprecision(4) << serialTime << " s, "
+         << (serialAnswer ? "proven" : "not proven") << "\n";
+
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        ParallelProver parallel(kb, factIds, threads);
+        auto t1 = chrono::steady_clock::now();
+        bool answer = parallel.prove(goal);
+        double time = chrono::duration<double>(chrono::steady_clock::now() - t1).count();
+        cout << "  " << setw(2) << threads << " threads       : " << time << " s, " << (answer ? "proven" : "not proven")
+             << "  (x" << setprecision(2) << serialTime / time << setprecision(4) << ")\n";
+    }
+}
+
+// A KB with two kinds of queries: the ends of many short independent chains, whose
+// cones are tiny, and propositions of one large random component, whose cones cover
+// most of it. Runs a mixed query stream through the planner and through each single
+// strategy.
+void benchmarkPlanner(int numQueries) {
+    vector<Rule> rules;
+    set<string> facts;
+    int chains = 2000, chainLength = 20, bigProps = 50000, bigRules = 200000;
+    for (int c = 0; c < chains; ++c) {
+        string name = "C" + to_string(c) + "_";
+        facts.insert(name + "0");
+        for (int i = 0; i < chainLength; ++i) rules.push_back({{name + to_string(i)}, name + to_string(i + 1)});
+    }
+    mt19937 rng(29);
+    for (int r = 0; r < bigRules; ++r) {
+        Rule rule;
+        for (int k = 0, n = 1 + rng() % 2; k < n; ++k) rule.premises.push_back("B" + to_string(rng() % bigProps));
+        rule.conclusion = "B" + to_string(rng() % bigProps);
+        rules.push_back(move(rule));
+    }
+    for (int f = 0; f < 200; ++f) facts.insert("B" + to_string(f));
+    CompiledKB kb = compileRules(rules, facts);
+    vector<int> factIds(kb.facts.begin(), kb.facts.end());
+
+    vector<int> queries;
+    for (int q = 0; q < numQueries; ++q)
+        queries.push_back(kb.symbols.find(q % 10 < 8 ? "C" + to_string(rng() % chains) + "_" + to_string(chainLength)
+                                                     : "B" + to_string(rng() % bigProps)));
+
+    QueryPlanner planner(kb);
+    double plannedTime = 0;
+    vector<bool> plannedAnswers;
+    cout << "query                plan      cone edges  estimate    time        answer\n";
+    for (int q = 0; q < (int)queries.size(); ++q) {
+        QueryPlanner::Report report = planner.query(queries[q]);
+        plannedTime += report.seconds;
+        plannedAnswers.push_back(report.proven);
+        if (q < 12 || report.plan == QueryPlanner::FORWARD)
+            cout << left << setw(20) << kb.symbols.name(queries[q]) << " " << setw(9)
+                 << QueryPlanner::planName(report.plan) << " " << right << setw(10) << report.coneEdges << "  "
+                 << scientific << setprecision(2) << report.estimate << "  " << report.seconds << "  "
+                 << (report.proven ? "proven" : "not proven") << fixed << "\n";
+    }
+    cout << "\n";
+    planner.printStatistics(cout);
+
+    auto t0 = chrono::steady_clock::now();
+    TabledProver backwardOnly(kb, factIds);
+    bool same = true;
+    for (int q = 0; q < (int)queries.size(); ++q) same = backwardOnly.prove(queries[q]) == plannedAnswers[q] && same;
+    auto t1 = chrono::steady_clock::now();
+    vector<char> expected = referenceClosure(kb);
+    auto t2 = chrono::steady_clock::now();
+    for (int q = 0; q < (int)queries.size(); ++q) same = (bool)expected[queries[q]] == plannedAnswers[q] && same;
+
+    cout << "\n" << queries.size() << " queries\n";
+    cout << "  planned      : " << setprecision(4) << plannedTime << " s\n";
+    cout << "  backward only: " << chrono::duration<double>(t1 - t0).count() << " s\n";
+    cout << "  naive closure: " << chrono::duration<double>(t2 - t1).count() << " s\n";
+    cout << "  answers " << (same ? "agree" : "DIFFER") << "\n";
+}
+
+// One JSON line per prover in the schema of instrumentation.h: the two-way chain of
+// benchmarkTabling for the original and the tabled prover, then the OR-branch KB of
+// benchmarkOrBranches for the serial and the parallel prover.
+void jsonReport(int depth) {
+    vector<Rule> rules;
+    for (int i = 0; i < depth; ++i) {
+        rules.push_back({{"P" + to_string(i)}, "P" + to_string(i + 1)});
+        rules.push_back({{"P" + to_string(i + 1)}, "P" + to_string(i)});
+    }
+    set<string> facts = {"P0"};
+    string goal = "P" + to_string(depth), instance = "two-way chain of depth " + to_string(depth);
+    {
+        set<string> known = facts, visited;
+        instr::Run run("backwardChaining", instance);
+        bool proven = backwardChaining(goal, rules, known, visited);
+        run.extra("proven", proven);
+        cout << run.finish() << "\n";
+    }
+    CompiledKB chain = compileRules(rules, facts);
+    {
+        instr::Run run("tabled prover", instance);
+        TabledProver prover(chain, vector<int>(chain.facts.begin(), chain.facts.end()));
+        bool proven = prover.prove(chain.symbols.find(goal));
+        run.extra("proven", proven);
+        cout << run.finish() << "\n";
+    }
+
+    int branches = 16;
+    rules.clear();
+    for (int k = 0; k < branches; ++k) {
+        string name = "B" + to_string(k) + "_";
+        for (int i = 0; i < depth; ++i) rules.push_back({{name + to_string(i)}, name + to_string(i + 1)});
+        rules.push_back({{name + to_string(depth)}, "G"});
+    }
+    CompiledKB orKB = compileRules(rules, {"B" + to_string(branches - 1) + "_0"});
+    vector<int> factIds(orKB.facts.begin(), orKB.facts.end());
+    instance = to_string(branches) + " OR-branches of depth " + to_string(depth);
+    {
+        instr::Run run("tabled prover", instance);
+        TabledProver prover(orKB, factIds);
+        run.extra("proven", prover.prove(orKB.symbols.find("G")));
+        cout << run.finish() << "\n";
+    }
+    {
+        int threads = (int)max(1u, thread::hardware_concurrency());
+        ParallelProver prover(orKB, factIds, threads);
+        instr::Run run("parallel prover", instance);
+        run.extra("proven", prover.prove(orKB.symbols.find("G"))).extra("threads", threads);
+        cout << run.finish() << "\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    // One JSON line per prover (schema in instrumentation.h); build with
+    // -DINSTRUMENTATION=1 for the work counters.
+    if (argc >= 2 && string(argv[1]) == "--json") {
+        jsonReport(argc >= 3 ? atoi(argv[2]) : 5000);
+        return 0;
+    }
+    if (argc >= 4 && string(argv[1]) == "--kb") {
+        // Prove goals from a KB file in the text or compiled format of knowledge_base.h,
+        // each with the plan the query planner picks for it.
+        CompiledKB kb;
+        if (!load_kb(argv[2], kb)) {
+            cerr << "Could not load " << argv[2] << "\n";
+            return 1;
+        }
+        QueryPlanner planner(kb);
+        for (int i = 3; i < argc; ++i) {
+            string goal = argv[i];
+            QueryPlanner::Report report = planner.query(kb.symbols.find(goal));
+            if (report.proven)
+                cout << "Goal " << goal << " is proven.";
+            else
+                cout << "Goal " << goal << " cannot be proven.";
+            cout << "  [" << QueryPlanner::planName(report.plan) << ", " << report.seconds * 1e6 << " us]\n";
+        }
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--planner") {
+        benchmarkPlanner(argc >= 3 ? atoi(argv[2]) : 1000);
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--check") {
+        checkTabling(argc >= 3 ? atoi(argv[2]) : 2000);
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--or-bench") {
+        // Deep enough that the recursive backwardChaining would run out of stack.
+        int threads = argc >= 5 ? atoi(argv[4]) : (int)max(1u, thread::hardware_concurrency());
+        benchmarkOrBranches(argc >= 3 ? atoi(argv[2]) : 16, argc >= 4 ? atoi(argv[3]) : 200000, threads);
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--bench") {
+        benchmarkTabling(argc >= 3 ? atoi(argv[2]) : 5000);
+        return 0;
+    }
+
     vector<Rule> rules = {
         {{"A","B"}, "C"},
         {{"C","D"}, "E"},
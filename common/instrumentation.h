@@ -0,0 +1,297 @@
+// Work counters, timers and hardware counters shared by every solver, reported as
+// one JSON object per run:
+//
+//   {"solver": "...", "instance": "...", "seconds": 0.0123, "nodes_per_second": ... or null,
+//    "counters": {"nodes_expanded": ..., "nodes_generated": ..., "pruned": ...,
+//                 "backtracks": ..., "table_probes": ..., "table_hits": ...,
+//                 "rules_fired": ..., "facts_derived": ...} or null,
+//    "hardware": {"cycles": ..., "instructions": ..., "ipc": ...,
+//                 "cache_misses": ..., "branch_misses": ...} or null,
+//    "extra": {...}}
+//
+// Every counter is present (zero if the solver has no use for it), so runs of
+// different engines line up field for field.
+//
+// INSTR_COUNT / INSTR_ADD bump a per-thread counter and instr::Tally keeps plain
+// tallies for inner loops; both compile to nothing unless INSTRUMENTATION is 1.
+// Counting is off by default, so the plain -O2 builds time the solvers as before;
+// build with -DINSTRUMENTATION=1 for "--json" runs. Without it "counters" and
+// "nodes_per_second" are null.
+// Timers and hardware counters are read once per run and are always available;
+// hardware counters come from perf_event_open and are reported as null where the
+// kernel does not allow it.
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef INSTRUMENTATION
+#define INSTRUMENTATION 0
+#endif
+
+namespace instr {
+
+enum Counter {
+    NODES_EXPANDED,     // states / positions / goals whose successors were looked at
+    NODES_GENERATED,    // successors produced
+    PRUNED,             // cutoffs, dead ends, successors rejected before being searched
+    BACKTRACKS,         // moves undone
+    TABLE_PROBES,       // transposition / memo / closed-set lookups
+    TABLE_HITS,         // lookups that found something usable
+    RULES_FIRED,        // rules whose premises were all satisfied
+    FACTS_DERIVED,      // new facts or proven goals
+    NUM_COUNTERS
+};
+
+inline const char* counter_name(int c) {
+    static const char* names[NUM_COUNTERS] = {"nodes_expanded", "nodes_generated", "pruned",      "backtracks",
+                                              "table_probes",   "table_hits",      "rules_fired", "facts_derived"};
+    return names[c];
+}
+
+struct CounterValues {
+    uint64_t value[NUM_COUNTERS] = {};
+
+    CounterValues operator-(const CounterValues& o) const {
+        CounterValues d;
+        for (int c = 0; c < NUM_COUNTERS; ++c) d.value[c] = value[c] - o.value[c];
+        return d;
+    }
+};
+
+// Each thread bumps its own counters (a relaxed load and store, no locked
+// instruction); totals are summed over the live threads plus whatever threads that
+// have exited left behind.
+class ThreadCounters {
+public:
+    ThreadCounters() {
+        std::lock_guard<std::mutex> lock(registry_mutex());
+        registry().push_back(this);
+    }
+
+    ~ThreadCounters() {
+        std::lock_guard<std::mutex> lock(registry_mutex());
+        for (int c = 0; c < NUM_COUNTERS; ++c) retired().value[c] += value[c].load(std::memory_order_relaxed);
+        auto& r = registry();
+        for (size_t i = 0; i < r.size(); ++i)
+            if (r[i] == this) {
+                r[i] = r.back();
+                r.pop_back();
+                break;
+            }
+    }
+
+    void add(Counter c, uint64_t n) { value[c].store(value[c].load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+
+    static ThreadCounters& local() {
+        static thread_local ThreadCounters counters;
+        return counters;
+    }
+
+    static CounterValues total() {
+        std::lock_guard<std::mutex> lock(registry_mutex());
+        CounterValues sum = retired();
+        for (ThreadCounters* t : registry())
+            for (int c = 0; c < NUM_COUNTERS; ++c) sum.value[c] += t->value[c].load(std::memory_order_relaxed);
+        return sum;
+    }
+
+private:
+    std::atomic<uint64_t> value[NUM_COUNTERS] = {};
+
+    static std::mutex& registry_mutex() {
+        static std::mutex m;
+        return m;
+    }
+
+    static std::vector<ThreadCounters*>& registry() {
+        static std::vector<ThreadCounters*> r;
+        return r;
+    }
+
+    static CounterValues& retired() {
+        static CounterValues r;
+        return r;
+    }
+};
+
+#if INSTRUMENTATION
+#define INSTR_ADD(counter, n) ::instr::ThreadCounters::local().add(::instr::counter, (n))
+#else
+#define INSTR_ADD(counter, n) ((void)0)
+#endif
+#define INSTR_COUNT(counter) INSTR_ADD(counter, 1)
+
+// Counts kept in a local array by a recursive search or a work item, without the
+// thread-local lookup and atomic store of INSTR_ADD on every node. flush() adds them
+// to the calling thread's counters in one go.
+struct Tally {
+    uint64_t value[NUM_COUNTERS] = {};
+
+    void add(Counter c, uint64_t n = 1) {
+#if INSTRUMENTATION
+        value[c] += n;
+#else
+        (void)c;
+        (void)n;
+#endif
+    }
+
+    void flush() {
+#if INSTRUMENTATION
+        ThreadCounters& counters = ThreadCounters::local();
+        for (int c = 0; c < NUM_COUNTERS; ++c)
+            if (value[c]) counters.add(Counter(c), value[c]);
+#endif
+        *this = Tally();
+    }
+};
+
+// Adds the time from construction to destruction, in seconds, to a variable.
+class ScopedTimer {
+public:
+    explicit ScopedTimer(double& seconds) : seconds(seconds), start(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() { seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); }
+
+private:
+    double& seconds;
+    std::chrono::steady_clock::time_point start;
+};
+
+struct HardwareValues {
+    bool available = false;
+    uint64_t cycles = 0, instructions = 0, cache_misses = 0, branch_misses = 0;
+};
+
+// Cycles, instructions, cache misses and branch misses of this process's threads
+// (including threads started after start()), through perf_event_open.
+class HardwareCounters {
+public:
+    HardwareCounters() {
+        const uint64_t configs[4] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                     PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+        for (int i = 0; i < 4; ++i) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.disabled = 1;
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        }
+    }
+
+    ~HardwareCounters() {
+        for (int fd : fds)
+            if (fd >= 0) close(fd);
+    }
+
+    HardwareCounters(const HardwareCounters&) = delete;
+    HardwareCounters& operator=(const HardwareCounters&) = delete;
+
+    bool available() const { return fds[0] >= 0 && fds[1] >= 0; }
+
+    void start() {
+        for (int fd : fds)
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+    }
+
+    HardwareValues stop() {
+        HardwareValues v;
+        uint64_t* out[4] = {&v.cycles, &v.instructions, &v.cache_misses, &v.branch_misses};
+        for (int i = 0; i < 4; ++i)
+            if (fds[i] >= 0) {
+                ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+                if (read(fds[i], out[i], sizeof(uint64_t)) != sizeof(uint64_t)) *out[i] = 0;
+            }
+        v.available = available();
+        return v;
+    }
+
+private:
+    int fds[4] = {-1, -1, -1, -1};
+};
+
+// One solver run: construct it just before the work, call finish() right after.
+// Counter values are the difference between the two points, summed over all threads.
+class Run {
+public:
+    Run(std::string solver, std::string instance)
+        : solver(std::move(solver)), instance(std::move(instance)), before(ThreadCounters::total()),
+          start(std::chrono::steady_clock::now()) {
+        hardware.start();
+    }
+
+    // Extra numbers specific to the solver (solution length, score, ...).
+    Run& extra(const std::string& key, double value) {
+        extras.emplace_back(key, value);
+        return *this;
+    }
+
+    std::string finish() {
+        HardwareValues hw = hardware.stop();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        CounterValues counters = ThreadCounters::total() - before;
+
+        std::ostringstream json;
+        json << "{\"solver\": \"" << escape(solver) << "\", \"instance\": \"" << escape(instance)
+             << "\", \"seconds\": " << seconds << ", \"nodes_per_second\": ";
+        if (INSTRUMENTATION) {
+            json << (seconds > 0 ? counters.value[NODES_EXPANDED] / seconds : 0) << ", \"counters\": ";
+            for (int c = 0; c < NUM_COUNTERS; ++c)
+                json << (c ? ", " : "{") << "\"" << counter_name(c) << "\": " << counters.value[c];
+            json << "}";
+        } else {
+            json << "null, \"counters\": null";
+        }
+        json << ", \"hardware\": ";
+        if (hw.available)
+            json << "{\"cycles\": " << hw.cycles << ", \"instructions\": " << hw.instructions
+                 << ", \"ipc\": " << (hw.cycles ? (double)hw.instructions / hw.cycles : 0)
+                 << ", \"cache_misses\": " << hw.cache_misses << ", \"branch_misses\": " << hw.branch_misses << "}";
+        else
+            json << "null";
+        json << ", \"extra\": {";
+        for (size_t i = 0; i < extras.size(); ++i)
+            json << (i ? ", " : "") << "\"" << escape(extras[i].first) << "\": " << extras[i].second;
+        json << "}}";
+        return json.str();
+    }
+
+private:
+    std::string solver, instance;
+    CounterValues before;
+    std::chrono::steady_clock::time_point start;
+    HardwareCounters hardware;
+    std::vector<std::pair<std::string, double>> extras;
+
+    static std::string escape(const std::string& s) {
+        std::string out;
+        for (char ch : s) {
+            if (ch == '"' || ch == '\\') out += '\\';
+            if ((unsigned char)ch >= 0x20) out += ch;
+        }
+        return out;
+    }
+};
+
+}  // namespace instr
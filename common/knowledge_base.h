@@ -0,0 +1,557 @@
+// Interned knowledge base shared by the forward (Assignment 7) and backward
+// (Assignment 8) chaining programs, with loaders for a text rule format and for a
+// compiled binary image of the interned KB.
+//
+// Text format, one statement per line ('#' starts a comment):
+//     A & B -> C      rule
+//     -> C            fact
+//     C               fact (so is "A & B": every name is asserted)
+//
+// Binary format: "KBC1", a header of counts, then the symbol table and every CSR
+// array as raw little-endian ints. Loading it maps the file and points the arrays
+// at it, so nothing is parsed or copied.
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Elements that are either owned or borrowed from a mapped file. Reads and writes in
+// place work either way (mappings are private, so writes never reach the file);
+// anything that changes the size copies a borrowed array first.
+template <class T>
+class Array {
+public:
+    Array() = default;
+    Array(std::initializer_list<T> init) : owned(init) { sync(); }
+    Array(std::vector<T>&& v) : owned(std::move(v)) { sync(); }
+    Array(const Array& other) { *this = other; }
+    Array(Array&& other) noexcept { *this = std::move(other); }
+
+    Array& operator=(const Array& other) {
+        if (this == &other) return *this;
+        if (other.view) {
+            owned.clear();
+            ptr = other.ptr, n = other.n, view = true;
+        } else {
+            owned = other.owned;
+            sync();
+        }
+        return *this;
+    }
+
+    Array& operator=(Array&& other) noexcept {
+        owned = std::move(other.owned);
+        ptr = other.ptr, n = other.n, view = other.view;
+        if (!view) sync();
+        other.owned.clear();
+        other.view = false;
+        other.sync();
+        return *this;
+    }
+
+    static Array borrow(T* data, size_t size) {
+        Array a;
+        a.ptr = data, a.n = size, a.view = true;
+        return a;
+    }
+
+    size_t size() const { return n; }
+    bool empty() const { return n == 0; }
+    T* data() { return ptr; }
+    const T* data() const { return ptr; }
+    T* begin() { return ptr; }
+    T* end() { return ptr + n; }
+    const T* begin() const { return ptr; }
+    const T* end() const { return ptr + n; }
+    T& operator[](size_t i) { return ptr[i]; }
+    const T& operator[](size_t i) const { return ptr[i]; }
+    const T& back() const { return ptr[n - 1]; }
+
+    void push_back(const T& value) {
+        own();
+        owned.push_back(value);
+        sync();
+    }
+
+    void resize(size_t size) {
+        own();
+        owned.resize(size);
+        sync();
+    }
+
+    void reserve(size_t size) {
+        own();
+        owned.reserve(size);
+        sync();
+    }
+
+    void assign(size_t size, const T& value) {
+        owned.assign(size, value);
+        view = false;
+        sync();
+    }
+
+    template <class It>
+    void assign(It first, It last) {
+        std::vector<T> copy(first, last);   // first..last may point into this array
+        owned.swap(copy);
+        view = false;
+        sync();
+    }
+
+private:
+    std::vector<T> owned;
+    T* ptr = nullptr;
+    size_t n = 0;
+    bool view = false;
+
+    void own() {
+        if (!view) return;
+        owned.assign(ptr, ptr + n);
+        view = false;
+    }
+
+    void sync() {
+        ptr = owned.data();
+        n = owned.size();
+    }
+};
+
+// Proposition names mapped to dense ids 0, 1, 2, ... in the order they were first
+// seen. Names are stored back to back in chars (name i is chars[offsets[i] ..
+// offsets[i+1])) and found through an open-addressing table of ids, so a mapped
+// binary KB can be searched without rebuilding anything.
+struct SymbolTable {
+    Array<char> chars;
+    Array<int> offsets{0};
+    Array<int> slots = Array<int>(std::vector<int>(16, -1));   // size is a power of two
+
+    int intern(std::string_view name) {
+        size_t slot = probe(name);
+        if (slots[slot] >= 0) return slots[slot];
+        int id = size();
+        for (char ch : name) chars.push_back(ch);
+        offsets.push_back((int)chars.size());
+        slots[slot] = id;
+        if (2 * (size_t)size() > slots.size()) rehash(2 * slots.size());
+        return id;
+    }
+
+    // -1 if the name was never interned
+    int find(std::string_view name) const { return slots[probe(name)]; }
+
+    std::string_view name(int id) const {
+        return std::string_view(chars.data() + offsets[id], offsets[id + 1] - offsets[id]);
+    }
+
+    int size() const { return (int)offsets.size() - 1; }
+
+    static uint64_t hash(std::string_view name) {
+        uint64_t h = 1469598103934665603ULL;   // FNV-1a
+        for (unsigned char ch : name) h = (h ^ ch) * 1099511628211ULL;
+        return h ^ (h >> 32);   // the low bits of FNV alone depend only on the low bits of the input
+    }
+
+private:
+    size_t probe(std::string_view name) const {
+        size_t mask = slots.size() - 1;
+        for (size_t s = hash(name) & mask;; s = (s + 1) & mask)
+            if (slots[s] < 0 || this->name(slots[s]) == name) return s;
+    }
+
+    void rehash(size_t capacity) {
+        std::vector<int> table(capacity, -1);
+        for (int id = 0; id < size(); ++id) {
+            size_t s = hash(name(id)) & (capacity - 1);
+            while (table[s] >= 0) s = (s + 1) & (capacity - 1);
+            table[s] = id;
+        }
+        slots = Array<int>(std::move(table));
+    }
+};
+
+// Keeps a mapped file alive for the arrays that point into it.
+struct MappedFile {
+    void* addr = MAP_FAILED;
+    size_t length = 0;
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Private writable mapping of the whole file; addr is MAP_FAILED on failure.
+    explicit MappedFile(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            length = st.st_size;
+            addr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+    }
+
+    ~MappedFile() {
+        if (addr != MAP_FAILED) munmap(addr, length);
+    }
+
+    bool ok() const { return addr != MAP_FAILED; }
+    const char* bytes() const { return static_cast<const char*>(addr); }
+};
+
+// Rules as flat arrays. The antecedents of rule r are
+// antecedents[rule_start[r] .. rule_start[r+1]) and its consequent is consequent[r].
+// The rules that have p as an antecedent are prop_rules[prop_start[p] .. prop_start[p+1])
+// (a compressed sparse row index); the rules that conclude p are likewise
+// conclusion_rules[conclusion_start[p] .. conclusion_start[p+1]). facts holds the
+// facts read from a KB file.
+struct CompiledKB {
+    SymbolTable symbols;
+    Array<int> rule_start{0};
+    Array<int> antecedents;
+    Array<int> consequent;
+    Array<int> prop_start{0};
+    Array<int> prop_rules;
+    Array<int> conclusion_start{0};
+    Array<int> conclusion_rules;
+    Array<int> facts;
+    std::shared_ptr<MappedFile> mapping;   // set when the arrays point into a binary KB file
+
+    int num_rules() const { return (int)consequent.size(); }
+    int num_props() const { return symbols.size(); }
+
+    // Interns a name that may not appear in any rule (e.g. a fact or a query).
+    int add_symbol(std::string_view name) {
+        int id = symbols.intern(name);
+        while ((int)prop_start.size() <= symbols.size()) prop_start.push_back(prop_start.back());
+        while ((int)conclusion_start.size() <= symbols.size()) conclusion_start.push_back(conclusion_start.back());
+        return id;
+    }
+
+    size_t index_bytes() const {
+        return (rule_start.size() + antecedents.size() + consequent.size() + prop_start.size() +
+                prop_rules.size() + conclusion_start.size() + conclusion_rules.size()) * sizeof(int);
+    }
+
+    // Builds both CSR indexes from rule_start, antecedents and consequent, by a
+    // counting sort of (proposition, rule) pairs by proposition.
+    void build_index() {
+        int n = symbols.size();
+        std::vector<int> start(n + 1, 0), rules(antecedents.size());
+        for (int a : antecedents) ++start[a + 1];
+        for (int p = 0; p < n; ++p) start[p + 1] += start[p];
+        std::vector<int> fill(start.begin(), start.end() - 1);
+        for (int r = 0; r < num_rules(); ++r)
+            for (int i = rule_start[r]; i < rule_start[r + 1]; ++i) rules[fill[antecedents[i]]++] = r;
+        prop_start = Array<int>(std::move(start));
+        prop_rules = Array<int>(std::move(rules));
+
+        start.assign(n + 1, 0);
+        rules.assign(consequent.size(), 0);
+        for (int c : consequent) ++start[c + 1];
+        for (int p = 0; p < n; ++p) start[p + 1] += start[p];
+        fill.assign(start.begin(), start.end() - 1);
+        for (int r = 0; r < num_rules(); ++r) rules[fill[consequent[r]]++] = r;
+        conclusion_start = Array<int>(std::move(start));
+        conclusion_rules = Array<int>(std::move(rules));
+    }
+};
+
+// One bit per proposition.
+struct FactSet {
+    std::vector<uint64_t> words;
+
+    explicit FactSet(int n = 0) : words((n + 63) / 64, 0) {}
+
+    bool test(int p) const { return (words[p >> 6] >> (p & 63)) & 1; }
+
+    // Returns true if p was not already set.
+    bool insert(int p) {
+        uint64_t bit = 1ULL << (p & 63);
+        if (words[p >> 6] & bit) return false;
+        words[p >> 6] |= bit;
+        return true;
+    }
+
+    void erase(int p) { words[p >> 6] &= ~(1ULL << (p & 63)); }
+
+    int count() const {
+        int c = 0;
+        for (uint64_t w : words) c += __builtin_popcountll(w);
+        return c;
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Text loader
+// ---------------------------------------------------------------------------
+
+namespace kb_detail {
+
+inline std::string_view trim(std::string_view s) {
+    size_t b = 0, e = s.size();
+    while (b < e && (s[b] == ' ' || s[b] == '\t' || s[b] == '\r')) ++b;
+    while (e > b && (s[e - 1] == ' ' || s[e - 1] == '\t' || s[e - 1] == '\r')) --e;
+    return s.substr(b, e - b);
+}
+
+// What one thread parsed, with ids local to its chunk in first-seen order.
+struct ChunkParse {
+    SymbolTable symbols;
+    std::vector<int> rule_start{0}, antecedents, consequent, facts;
+    bool ok = true;
+
+    int intern(std::string_view name) { return symbols.intern(name); }
+
+    // Adds every '&'-separated name of s to out; false if one of them is empty.
+    bool names_in(std::string_view s, std::vector<int>& out) {
+        for (;;) {
+            size_t amp = s.find('&');
+            std::string_view name = trim(s.substr(0, amp));
+            if (name.empty()) return false;
+            out.push_back(intern(name));
+            if (amp == std::string_view::npos) return true;
+            s.remove_prefix(amp + 1);
+        }
+    }
+
+    void parse_line(std::string_view line) {
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) return;
+        size_t arrow = line.find("->");
+        if (arrow == std::string_view::npos) {
+            ok = names_in(line, facts) && ok;
+            return;
+        }
+        std::string_view body = trim(line.substr(0, arrow)), head = trim(line.substr(arrow + 2));
+        if (head.empty() || head.find('&') != std::string_view::npos) {
+            ok = false;
+            return;
+        }
+        if (body.empty()) {
+            facts.push_back(intern(head));
+            return;
+        }
+        size_t mark = antecedents.size();
+        if (!names_in(body, antecedents)) {
+            antecedents.resize(mark);
+            ok = false;
+            return;
+        }
+        rule_start.push_back((int)antecedents.size());
+        consequent.push_back(intern(head));
+    }
+
+    void parse(std::string_view text) {
+        while (!text.empty()) {
+            size_t nl = text.find('\n');
+            parse_line(text.substr(0, nl));
+            if (nl == std::string_view::npos) break;
+            text.remove_prefix(nl + 1);
+        }
+    }
+};
+
+}  // namespace kb_detail
+
+// Parses a text KB into kb. The file is mapped and cut into num_threads chunks at
+// line breaks (0 = hardware concurrency); each chunk is parsed and interned locally
+// in parallel, then the local symbol tables are merged in file order, so ids come
+// out exactly as a single-threaded parse would number them. Returns false if the
+// file cannot be read or has a malformed line.
+inline bool load_kb_text(const std::string& path, CompiledKB& kb, int num_threads = 0) {
+    MappedFile file(path);
+    struct stat st;
+    if (!file.ok() && !(stat(path.c_str(), &st) == 0 && st.st_size == 0)) return false;
+    std::string_view text = file.ok() ? std::string_view(file.bytes(), file.length) : std::string_view();
+
+    if (num_threads <= 0) num_threads = std::max(1u, std::thread::hardware_concurrency());
+    num_threads = (int)std::max<size_t>(1, std::min<size_t>(num_threads, text.size() / (1 << 16)));
+    std::vector<size_t> cut{0};
+    for (int t = 1; t < num_threads; ++t) {
+        size_t at = std::max(cut.back(), text.size() * t / num_threads);
+        size_t nl = text.find('\n', at);
+        cut.push_back(nl == std::string_view::npos ? text.size() : nl + 1);
+    }
+    cut.push_back(text.size());
+
+    std::vector<kb_detail::ChunkParse> chunks(num_threads);
+    auto parallel = [&](auto&& job) {
+        std::vector<std::thread> pool;
+        for (int t = 1; t < num_threads; ++t) pool.emplace_back(job, t);
+        job(0);
+        for (auto& th : pool) th.join();
+    };
+    parallel([&](int t) { chunks[t].parse(text.substr(cut[t], cut[t + 1] - cut[t])); });
+
+    CompiledKB result;
+    std::vector<std::vector<int>> to_global(num_threads);
+    size_t num_rules = 0, num_antecedents = 0, num_facts = 0;
+    std::vector<size_t> rule_base(num_threads), antecedent_base(num_threads), fact_base(num_threads);
+    for (int t = 0; t < num_threads; ++t) {
+        if (!chunks[t].ok) return false;
+        const SymbolTable& local = chunks[t].symbols;
+        for (int id = 0; id < local.size(); ++id) to_global[t].push_back(result.symbols.intern(local.name(id)));
+        rule_base[t] = num_rules, antecedent_base[t] = num_antecedents, fact_base[t] = num_facts;
+        num_rules += chunks[t].consequent.size();
+        num_antecedents += chunks[t].antecedents.size();
+        num_facts += chunks[t].facts.size();
+    }
+
+    std::vector<int> rule_start(num_rules + 1), antecedents(num_antecedents), consequent(num_rules), facts(num_facts);
+    parallel([&](int t) {
+        const kb_detail::ChunkParse& c = chunks[t];
+        const std::vector<int>& g = to_global[t];
+        for (size_t r = 0; r < c.consequent.size(); ++r) {
+            rule_start[rule_base[t] + r] = (int)antecedent_base[t] + c.rule_start[r];
+            consequent[rule_base[t] + r] = g[c.consequent[r]];
+        }
+        for (size_t i = 0; i < c.antecedents.size(); ++i) antecedents[antecedent_base[t] + i] = g[c.antecedents[i]];
+        for (size_t i = 0; i < c.facts.size(); ++i) facts[fact_base[t] + i] = g[c.facts[i]];
+    });
+    rule_start[num_rules] = (int)num_antecedents;
+
+    result.rule_start = Array<int>(std::move(rule_start));
+    result.antecedents = Array<int>(std::move(antecedents));
+    result.consequent = Array<int>(std::move(consequent));
+    result.facts = Array<int>(std::move(facts));
+    result.build_index();
+    kb = std::move(result);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Binary image
+// ---------------------------------------------------------------------------
+
+struct KBFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t num_symbols, name_bytes, num_slots, num_rules, num_antecedents, num_facts;
+};
+
+const uint32_t KB_FILE_VERSION = 1;
+
+// Layout after the header, every section padded to 8 bytes: name offsets, name
+// characters, symbol slots, rule_start, antecedents, consequent, prop_start,
+// prop_rules, conclusion_start, conclusion_rules, facts.
+inline bool save_kb_binary(const CompiledKB& kb, const std::string& path) {
+    std::ofstream out(path, std::ios::binary);
+    const SymbolTable& s = kb.symbols;
+    KBFileHeader header = {{'K', 'B', 'C', '1'}, KB_FILE_VERSION, (uint64_t)s.size(), s.chars.size(),
+                           s.slots.size(), (uint64_t)kb.num_rules(), kb.antecedents.size(), kb.facts.size()};
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    auto section = [&](const void* data, size_t bytes) {
+        static const char zeros[8] = {};
+        out.write(static_cast<const char*>(data), bytes);
+        out.write(zeros, (8 - bytes % 8) % 8);
+    };
+    auto ints = [&](const Array<int>& a) { section(a.data(), a.size() * sizeof(int)); };
+    ints(s.offsets);
+    section(s.chars.data(), s.chars.size());
+    ints(s.slots);
+    ints(kb.rule_start);
+    ints(kb.antecedents);
+    ints(kb.consequent);
+    ints(kb.prop_start);
+    ints(kb.prop_rules);
+    ints(kb.conclusion_start);
+    ints(kb.conclusion_rules);
+    ints(kb.facts);
+    return bool(out);
+}
+
+// Maps a file written by save_kb_binary and points kb's arrays into it. Returns false
+// (leaving kb alone) if the file is missing, truncated or not a KB image. Since the
+// arrays are used without bounds checks, every index and offset in them is checked
+// once here: the *_start arrays must run from 0 up to the size of what they index,
+// and every id must name a symbol or a rule.
+inline bool load_kb_binary(const std::string& path, CompiledKB& kb) {
+    auto file = std::make_shared<MappedFile>(path);
+    if (!file->ok() || file->length < sizeof(KBFileHeader)) return false;
+    KBFileHeader header;
+    memcpy(&header, file->bytes(), sizeof(header));
+    if (memcmp(header.magic, "KBC1", 4) != 0 || header.version != KB_FILE_VERSION) return false;
+    if (header.num_slots == 0 || (header.num_slots & (header.num_slots - 1)) != 0) return false;
+    // Ids and offsets are ints, and a full slot table would make lookups spin forever.
+    const uint64_t MAX_COUNT = INT32_MAX - 1;
+    if (header.num_symbols > MAX_COUNT || header.name_bytes > MAX_COUNT || header.num_slots > MAX_COUNT ||
+        header.num_rules > MAX_COUNT || header.num_antecedents > MAX_COUNT || header.num_facts > MAX_COUNT ||
+        header.num_slots <= header.num_symbols)
+        return false;
+
+    char* base = static_cast<char*>(file->addr);
+    size_t at = sizeof(header);
+    bool fits = true;
+    auto section = [&](size_t bytes) {
+        char* p = base + at;
+        if (bytes > file->length - at) fits = false;
+        at = fits ? std::min(file->length, at + (bytes + 7) / 8 * 8) : file->length;
+        return p;
+    };
+    auto ints = [&](uint64_t count) {
+        if (count > (file->length - at) / sizeof(int)) fits = false;
+        int* p = reinterpret_cast<int*>(section(fits ? count * sizeof(int) : file->length));
+        return fits ? Array<int>::borrow(p, count) : Array<int>();
+    };
+
+    CompiledKB result;
+    uint64_t n = header.num_symbols;
+    result.symbols.offsets = ints(n + 1);
+    char* chars = section(header.name_bytes);
+    result.symbols.chars = fits ? Array<char>::borrow(chars, header.name_bytes) : Array<char>();
+    result.symbols.slots = ints(header.num_slots);
+    result.rule_start = ints(header.num_rules + 1);
+    result.antecedents = ints(header.num_antecedents);
+    result.consequent = ints(header.num_rules);
+    result.prop_start = ints(n + 1);
+    result.prop_rules = ints(header.num_antecedents);
+    result.conclusion_start = ints(n + 1);
+    result.conclusion_rules = ints(header.num_rules);
+    result.facts = ints(header.num_facts);
+    if (!fits) return false;
+
+    auto starts = [](const Array<int>& a, uint64_t end) {
+        if (a[0] != 0 || (uint64_t)a[a.size() - 1] != end) return false;
+        for (size_t i = 1; i < a.size(); ++i)
+            if (a[i] < a[i - 1]) return false;
+        return true;
+    };
+    auto ids = [](const Array<int>& a, uint64_t limit, bool allow_empty = false) {
+        for (size_t i = 0; i < a.size(); ++i)
+            if (a[i] < 0 ? !(allow_empty && a[i] == -1) : (uint64_t)a[i] >= limit) return false;
+        return true;
+    };
+    if (!starts(result.symbols.offsets, header.name_bytes) || !starts(result.rule_start, header.num_antecedents) ||
+        !starts(result.prop_start, header.num_antecedents) || !starts(result.conclusion_start, header.num_rules))
+        return false;
+    if (!ids(result.symbols.slots, n, true) || !ids(result.antecedents, n) || !ids(result.consequent, n) ||
+        !ids(result.facts, n) || !ids(result.prop_rules, header.num_rules) ||
+        !ids(result.conclusion_rules, header.num_rules))
+        return false;
+    result.mapping = std::move(file);
+    kb = std::move(result);
+    return true;
+}
+
+// Loads either format, telling them apart by the binary magic.
+inline bool load_kb(const std::string& path, CompiledKB& kb, int num_threads = 0) {
+    char magic[4] = {};
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    in.read(magic, 4);
+    if (in.gcount() == 4 && memcmp(magic, "KBC1", 4) == 0) return load_kb_binary(path, kb);
+    return load_kb_text(path, kb, num_threads);
+}